@@ -87,6 +87,9 @@ void MainWindow::on_actionOpen_triggered()
     if (rv == 0) {
         Song::setCurrentSong(&currentSong);
 
+        // The user will probably look at the maps, so read them while they look at the info page.
+        currentSong.prefetchBeatmaps();
+
 //        currentSong.startPlaying();
 
         // Switch to the song info page.
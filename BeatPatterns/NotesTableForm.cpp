@@ -103,10 +103,12 @@ NotesTableForm::view(BeatPatterns::LevelDifficulty difficulty) {
 
 void
 NotesTableForm::updateDetails() {
-    long noteCount = data->notes.size();
+    double duration = currentSong->duration;
+    SongBeatmapData::MapStats stats = data->computeStats(duration, currentSong->info.beatsPerMinute);
+
+    long noteCount = stats.noteCount;
     ui->totalNotesTF->setText(QString::fromStdString(std::to_string(noteCount)));
 
-    double duration = currentSong->duration;
     double notesPerSecond = 0.0;
     if (duration > 1.0) {
         notesPerSecond = noteCount / duration;
@@ -115,17 +117,17 @@ NotesTableForm::updateDetails() {
     sprintf(buf, "%.2f", notesPerSecond);
     ui->notesPerSecondTF->setText(QString::fromStdString(string(buf)));
 
-    sprintf(buf, "%.2f seconds", data->largestGap(duration, currentSong->info.beatsPerMinute));
+    sprintf(buf, "%.2f seconds", stats.largestGap);
     ui->largestGapTF->setText(QString::fromStdString(string(buf)));
 
-    sprintf(buf, "%d", data->numberLargeGaps(duration, currentSong->info.beatsPerMinute));
+    sprintf(buf, "%d", stats.numberLargeGaps);
     ui->numLargsGapsTF->setText(QString::fromStdString(string(buf)));
 
-    ui->redCutsTF->setText( QString::fromStdString( std::to_string(data->getCutsCount(CubeType::Red)) ));
-    ui->blueCutsTF->setText( QString::fromStdString( std::to_string(data->getCutsCount(CubeType::Blue)) ));
-    ui->upDownCutsTF->setText( QString::fromStdString( std::to_string(data->getUpDownCuts()) ));
-    ui->leftRightCutsTF->setText( QString::fromStdString( std::to_string(data->getLeftRightCuts()) ));
-    ui->diagonalCutsTF->setText( QString::fromStdString( std::to_string(data->getDiagonalCuts()) ));
+    ui->redCutsTF->setText( QString::fromStdString( std::to_string(stats.redCuts) ));
+    ui->blueCutsTF->setText( QString::fromStdString( std::to_string(stats.blueCuts) ));
+    ui->upDownCutsTF->setText( QString::fromStdString( std::to_string(stats.upDownCuts) ));
+    ui->leftRightCutsTF->setText( QString::fromStdString( std::to_string(stats.leftRightCuts) ));
+    ui->diagonalCutsTF->setText( QString::fromStdString( std::to_string(stats.diagonalCuts) ));
 }
 
 //======================================================================
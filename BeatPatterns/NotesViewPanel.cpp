@@ -129,14 +129,7 @@ NotesViewPanel::setLocation(int index, BeatPatterns::SongBeatmapData * dataP) {
     timeToNextTF->setText(QString(buf));
 
     if (myNote != nullptr) {
-        SongBeatmapData::Note * firstNote = beatmapData->notes.at(myIndex);
-        showNote(*firstNote);
-        for (int index = myIndex; index < beatmapData->notes.size(); ++index) {
-            SongBeatmapData::Note * note = beatmapData->notes.at(index);
-            if (note->time > firstNote->time) {
-                break;
-            }
-        }
+        showNote(beatmapData->notes.at(myIndex));
     }
 }
 
@@ -33,9 +33,8 @@ void SongInfoForm::setSong(Song *value) {
     ui->bpmTF->setText(QString::fromStdString(to_string(currentSong->info.beatsPerMinute)));
     ui->offsetTimeTF->setText(QString::fromStdString(to_string(currentSong->info.songTimeOffset)));
 
-    sf::Time duration = currentSong->music.getDuration();
-    int seconds = static_cast<int>(duration.asSeconds());
-    int millis = duration.asMilliseconds();
+    int seconds = static_cast<int>(currentSong->duration);
+    int millis = static_cast<int>(currentSong->duration * 1000.0);
 
     int minutes = seconds / 60;
     seconds = seconds % 60;
@@ -19,44 +19,67 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    src/showpage/BlockCompression.cpp \
     src/showpage/FileUtilities.cpp \
     src/showpage/JSON_Serializable.cpp \
+    src/showpage/LockFreeWorkQueue.cpp \
+    src/showpage/MappedFile.cpp \
     src/showpage/OptionHandler.cpp \
+    src/showpage/Profiler.cpp \
     src/showpage/StringMethods.cpp \
     src/showpage/StringVector.cpp \
+    src/showpage/ThreadPool.cpp \
+    src/showpage/TimingWheel.cpp \
     src/showpage/URI.cpp \
     src/showpage/WaitCondition.cpp \
     src/showpage/WorkQueue.cpp \
+    src/beat_patterns/BeatmapBinary.cpp \
     src/beat_patterns/CLI.cpp \
     src/beat_patterns/Common.cpp \
     src/beat_patterns/Generator.cpp \
+    src/beat_patterns/OggProbe.cpp \
     src/beat_patterns/Pattern.cpp \
+    src/beat_patterns/PatternCache.cpp \
     src/beat_patterns/Preferences.cpp \
+    src/beat_patterns/Random.cpp \
     src/beat_patterns/SaberLocation.cpp \
-    src/beat_patterns/Song.cpp
+    src/beat_patterns/Song.cpp \
+    src/beat_patterns/SongIndex.cpp
 
 HEADERS += \
     include/chrono_io.h \
     include/date.h \
     include/json.hpp \
+    src/showpage/BinaryCodec.h \
+    src/showpage/BlockCompression.h \
     src/showpage/FileUtilities.h \
     src/showpage/JSON_Serializable.h \
+    src/showpage/LockFreeWorkQueue.h \
+    src/showpage/MappedFile.h \
     src/showpage/OptionHandler.h \
     src/showpage/PointerMap.h \
     src/showpage/PointerVector.h \
+    src/showpage/Profiler.h \
     src/showpage/StringMethods.h \
     src/showpage/StringVector.h \
+    src/showpage/ThreadPool.h \
+    src/showpage/TimingWheel.h \
     src/showpage/URI.h \
     src/showpage/UnitTesting.h \
     src/showpage/WaitCondition.h \
     src/showpage/WorkQueue.h \
+    src/beat_patterns/BeatmapBinary.h \
     src/beat_patterns/CLI.h \
     src/beat_patterns/Common.h \
     src/beat_patterns/Generator.h \
+    src/beat_patterns/OggProbe.h \
     src/beat_patterns/Pattern.h \
+    src/beat_patterns/PatternCache.h \
     src/beat_patterns/Preferences.h \
+    src/beat_patterns/Random.h \
     src/beat_patterns/SaberLocation.h \
-    src/beat_patterns/Song.h
+    src/beat_patterns/Song.h \
+    src/beat_patterns/SongIndex.h
 
 # Default rules for deployment.
 unix {
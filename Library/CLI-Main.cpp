@@ -1,11 +1,50 @@
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <showpage/Profiler.h>
 #include <beat_patterns/CLI.h>
 #include <beat_patterns/Preferences.h>
 
+/** For --profile. Counted by our operator new below. */
+static Profiler::Counter allocations("allocations");
+
+/**
+ * Count allocations when we're profiling. When we aren't, this is plain malloc.
+ */
+void *
+operator new(std::size_t size) {
+    Profiler::count(allocations);
+
+    void * retVal = std::malloc(size == 0 ? 1 : size);
+    if (retVal == nullptr) {
+        throw std::bad_alloc();
+    }
+    return retVal;
+}
+
+void
+operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void
+operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
 /**
  * Entrypoint.
  */
 int main(int argc, char **argv) {
+    // The preferences and patterns load before we parse the arguments, so look
+    // for --profile now if we're going to time that too.
+    for (int index = 1; index < argc; ++index) {
+        if (strcmp(argv[index], "--profile") == 0) {
+            Profiler::setEnabled(true);
+        }
+    }
+
     BeatPatterns::Preferences::setupForCLI();
     BeatPatterns::CLI cli;
     cli.parseArgs(argc, argv);
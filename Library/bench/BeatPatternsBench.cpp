@@ -0,0 +1,323 @@
+/**
+ * Benchmarks for the library. Everything runs on synthetic data made from fixed
+ * seeds, so runs are comparable from one release to the next. Results go to
+ * stdout (or --output file) as JSON:
+ *
+ * 		{ "benchmarks": [ { "name": "...", "parameter": ..., "iterations": ...,
+ * 		                    "secondsPerIteration": ..., "itemsPerSecond": ... }, ... ] }
+ *
+ * To run:
+ *
+ * 		make bench
+ * 		./BeatPatternsBench [--output results.json] [--min-seconds 0.25]
+ *
+ * Run it from Library (or anywhere the CLI can find the Patterns directory).
+ */
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <showpage/OptionHandler.h>
+
+#include <beat_patterns/BeatmapBinary.h>
+#include <beat_patterns/Generator.h>
+#include <beat_patterns/Pattern.h>
+#include <beat_patterns/Preferences.h>
+#include <beat_patterns/Random.h>
+#include <beat_patterns/Song.h>
+
+using namespace std;
+using namespace BeatPatterns;
+using JSON = nlohmann::json;
+
+static double minSeconds = 0.25;
+static JSON results = JSON::array();
+
+/**
+ * Run body until at least minSeconds have gone by, then record how long each run
+ * took. itemsPerRun is how many things (notes, draws...) one run handles.
+ */
+static void
+measure(const string &name, long parameter, double itemsPerRun, const function<void()> &body) {
+    using Clock = chrono::steady_clock;
+
+    long iterations = 0;
+    double seconds = 0.0;
+    Clock::time_point start = Clock::now();
+
+    do {
+        body();
+        ++iterations;
+        seconds = chrono::duration<double>(Clock::now() - start).count();
+    } while (seconds < minSeconds);
+
+    JSON result;
+    result["name"] = name;
+    result["parameter"] = parameter;
+    result["iterations"] = iterations;
+    result["secondsPerIteration"] = seconds / iterations;
+    result["itemsPerSecond"] = itemsPerRun * iterations / seconds;
+    results.push_back(result);
+
+    cerr << name << " (" << parameter << "): " << (seconds / iterations * 1000.0) << " ms" << endl;
+}
+
+/**
+ * A map with this many notes. Notes land on quarter, half or whole beats, with
+ * the occasional two-note chord, and there's a lighting event every few notes.
+ */
+static void
+makeSyntheticMap(SongBeatmapData &data, size_t noteCount, uint64_t seed) {
+    static const double steps[] = { 0.25, 0.5, 0.5, 1.0 };
+    Random random(seed);
+    double time = 4.0;
+
+    data.version = "2.0.0";
+    data.notes.clear();
+    data.events.clear();
+
+    while (data.notes.size() < noteCount) {
+        SongBeatmapData::Note note;
+        note.time = time;
+        note.lineIndex = static_cast<int>(random.next() % 4);
+        note.lineLayer = static_cast<int>(random.next() % 3);
+        note.type = static_cast<int>(random.next() % 2);
+        note.cutDirection = static_cast<int>(random.next() % 9);
+        data.notes.push_back(note);
+
+        // A chord: the other saber at the same time.
+        if (random.next() % 4 == 0 && data.notes.size() < noteCount) {
+            note.lineIndex = 3 - note.lineIndex;
+            note.type = 1 - note.type;
+            data.notes.push_back(note);
+        }
+
+        if (random.next() % 4 == 0) {
+            SongBeatmapData::Event event;
+            event.time = time;
+            event.type = static_cast<int>(random.next() % 5);
+            event.value = static_cast<int>(random.next() % 8);
+            data.events.push_back(event);
+        }
+
+        time += steps[random.next() % 4];
+    }
+    data.markChanged();
+}
+
+/**
+ * Save and load maps of a few sizes, as JSON and as our binary copy.
+ */
+static void
+benchLoadSave(const string &tempDir) {
+    for (size_t noteCount: { 1000, 10000, 100000 }) {
+        string fileName = tempDir + "/Bench" + to_string(noteCount) + ".dat";
+        SongBeatmapData data;
+        makeSyntheticMap(data, noteCount, noteCount);
+
+        measure("beatmapSave", static_cast<long>(noteCount), noteCount, [&]() {
+            data.save(fileName);
+        });
+        measure("beatmapLoad", static_cast<long>(noteCount), noteCount, [&]() {
+            SongBeatmapData loaded;
+            loaded.load(fileName);
+        });
+
+        string binaryName = BeatmapBinary::sidecarName(fileName);
+        measure("beatmapSaveBinary", static_cast<long>(noteCount), noteCount, [&]() {
+            BeatmapBinary::save(data, binaryName);
+        });
+        measure("beatmapLoadBinary", static_cast<long>(noteCount), noteCount, [&]() {
+            SongBeatmapData loaded;
+            BeatmapBinary::load(loaded, binaryName);
+        });
+    }
+}
+
+/**
+ * Loading the pattern files, building a PatternIndex, then drawing patterns from it.
+ */
+static void
+benchPatterns(const string &patternDir) {
+    if (patternDir.empty()) {
+        cerr << "No Patterns directory, so skipping the pattern benchmarks." << endl;
+        return;
+    }
+
+    Pattern_Vec patterns;
+    measure("patternVecLoad", 0, 1, [&]() {
+        Pattern_Vec loaded(true);
+        loaded.load(patternDir);
+    });
+
+    patterns.load(patternDir);
+
+    std::map<string, Pattern *> patternMap;
+    patterns.mapInto(patternMap);
+
+    const long draws = 100000;
+    Random random(1);
+
+    measure("patternIndexBuild", static_cast<long>(patterns.size()), 1, [&]() {
+        PatternIndex index;
+        index.build(patterns, LevelDifficulty::Hard, 120);
+    });
+
+    // What the generator does for each pattern: look up the candidates for where
+    // the sabers are, then draw one. The sabers wander so we hit different buckets.
+    shared_ptr<const PatternIndex> index = patterns.getIndex(LevelDifficulty::Hard, 120);
+    SaberLocation red;
+    SaberLocation blue;
+
+    measure("patternIndexLookup", static_cast<long>(index->samplerCount()), draws, [&]() {
+        for (long count = 0; count < draws; ++count) {
+            red.row = count % 3;
+            red.col = count % 4;
+            blue.lastCutDirection = static_cast<CutDirection>(count % 9);
+            index->lookup(red, blue, static_cast<double>(count % 6)).sample(random);
+        }
+    });
+
+    const PatternSampler & sampler = index->lookup(SaberLocation(), SaberLocation(), 1000.0);
+    measure("patternSamplerSample", static_cast<long>(sampler.size()), draws, [&]() {
+        for (long count = 0; count < draws; ++count) {
+            sampler.sample(random);
+        }
+    });
+}
+
+/**
+ * Generate a whole three minute song at each difficulty, with the patterns the CLI uses.
+ */
+static void
+benchGenerator() {
+    static const LevelDifficulty difficulties[] = {
+        LevelDifficulty::Easy, LevelDifficulty::Normal, LevelDifficulty::Hard,
+        LevelDifficulty::Expert, LevelDifficulty::ExpertPlus
+    };
+
+    Song song;
+    song.info.beatsPerMinute = 120;
+    song.duration = 180.0;
+    song.fixBeatDuration();
+
+    for (LevelDifficulty difficulty: difficulties) {
+        SongDifficulty * songDifficulty = song.createDifficulty(difficulty);
+        SongBeatmapData * data = song.getBeatmap(songDifficulty->beatmapFilename);
+        Generator generator(song, *songDifficulty, *data);
+
+        generator.setSeed(42);
+        generator.generateEntireSong();
+        double noteCount = static_cast<double>(data->notes.size());
+
+        measure("generateSong" + levelDifficultyToString(difficulty), static_cast<long>(noteCount), noteCount, [&]() {
+            generator.setSeed(42);
+            generator.generateEntireSong();
+        });
+    }
+}
+
+/**
+ * Looking things up by time, and the statistics the notes table shows.
+ */
+static void
+benchAnalytics() {
+    const size_t noteCount = 100000;
+    SongBeatmapData data;
+    makeSyntheticMap(data, noteCount, 7);
+
+    double endTime = data.notes.back().time;
+    const long lookups = 100000;
+    Random random(3);
+
+    measure("indexAfter", static_cast<long>(noteCount), lookups, [&]() {
+        for (long count = 0; count < lookups; ++count) {
+            data.indexAfter(random.fraction() * endTime);
+        }
+    });
+
+    measure("timeIndexBuild", static_cast<long>(noteCount), noteCount, [&]() {
+        data.markChanged();
+        data.getTimeIndex();
+    });
+
+    measure("computeStats", static_cast<long>(noteCount), noteCount, [&]() {
+        data.markChanged();
+        data.computeStats(endTime / 2.0, 120);
+    });
+
+    measure("computeStatsCached", static_cast<long>(noteCount), 1, [&]() {
+        data.computeStats(endTime / 2.0, 120);
+    });
+
+    measure("getCutsCount", static_cast<long>(noteCount), noteCount * 5, [&]() {
+        data.getCutsCount(CubeType::Red);
+        data.getCutsCount(CubeType::Blue);
+        data.getUpDownCuts();
+        data.getLeftRightCuts();
+        data.getDiagonalCuts();
+    });
+}
+
+/**
+ * Same places the CLI looks.
+ */
+static string
+findPatternDir() {
+    for (const char *location: { "/usr/local/etc/BeatPatterns/Patterns",
+                                 "/Applications/BeatPatterns.app/Contents/Resources/Patterns",
+                                 "Patterns", "../BeatPatterns/Patterns" }) {
+        if (boost::filesystem::is_directory(location)) {
+            return location;
+        }
+    }
+    return "";
+}
+
+int main(int argc, char **argv) {
+    string outputFile;
+
+    OptionHandler::Argument args[] = {
+        { "output",      required_argument, [&](const char *arg) { outputFile = arg; }},
+        { "min-seconds", required_argument, [&](const char *arg) { minSeconds = atof(arg); }},
+        {nullptr}
+    };
+
+    OptionHandler::ArgumentVector vec;
+    vec.addAll(args);
+    OptionHandler::handleOptions(argc, argv, vec, [=]() {
+        cerr << argv[0] << " [--output file] [--min-seconds s]" << endl;
+        exit(0);
+    });
+
+    Preferences::setupForCLI();
+
+    boost::filesystem::path tempDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("BeatPatternsBench-%%%%%%");
+    boost::filesystem::create_directories(tempDir);
+
+    benchLoadSave(tempDir.string());
+    benchPatterns(findPatternDir());
+    benchGenerator();
+    benchAnalytics();
+
+    boost::filesystem::remove_all(tempDir);
+
+    JSON output;
+    output["benchmarks"] = results;
+
+    if (outputFile.empty()) {
+        cout << output.dump(2) << endl;
+    }
+    else {
+        ofstream file(outputFile);
+        file << output.dump(2) << endl;
+    }
+
+    return 0;
+}
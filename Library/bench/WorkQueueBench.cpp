@@ -0,0 +1,79 @@
+/**
+ * Compare WorkQueue with LockFreeWorkQueue: several producers adding untimed
+ * entries as fast as they can, one consumer taking them out. The entries are
+ * made before we start the clock, so we're timing the queues, not make_shared.
+ *
+ * 		WorkQueueBench [entries]
+ */
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include <showpage/WorkQueue.h>
+#include <showpage/LockFreeWorkQueue.h>
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Push entryCount entries through this queue with this many producers. Returns millions per second.
+ */
+template <class QueueType>
+double
+runOne(size_t producerCount, size_t entryCount) {
+    QueueType queue;
+    size_t perProducer = entryCount / producerCount;
+    size_t total = perProducer * producerCount;
+
+    vector<vector<WorkQueue_Entry::Ptr>> entries(producerCount);
+    for (vector<WorkQueue_Entry::Ptr> &theseEntries: entries) {
+        for (size_t index = 0; index < perProducer; ++index) {
+            theseEntries.push_back(make_shared<WorkQueue_Entry>());
+        }
+    }
+
+    steady_clock::time_point start = steady_clock::now();
+
+    vector<thread> producers;
+    for (size_t producer = 0; producer < producerCount; ++producer) {
+        producers.push_back(thread([&queue, &entries, producer]() {
+            for (WorkQueue_Entry::Ptr &entry: entries[producer]) {
+                queue.add(std::move(entry));
+            }
+        }));
+    }
+
+    for (size_t received = 0; received < total; ) {
+        if (queue.getMoreWork(milliseconds(1000)) != nullptr) {
+            ++received;
+        }
+    }
+
+    steady_clock::time_point end = steady_clock::now();
+    for (thread &producer: producers) {
+        producer.join();
+    }
+
+    double seconds = duration_cast<duration<double>>(end - start).count();
+    return static_cast<double>(total) / seconds / 1000000.0;
+}
+
+int main(int argc, char **argv) {
+    size_t entryCount = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 1000000;
+
+    cout << "Entries: " << entryCount << "  (millions per second)" << endl;
+    cout << setw(10) << "Producers" << setw(12) << "WorkQueue" << setw(12) << "LockFree" << endl;
+
+    for (size_t producerCount: { 1, 4, 16 }) {
+        double locked = runOne<WorkQueue>(producerCount, entryCount);
+        double lockFree = runOne<LockFreeWorkQueue>(producerCount, entryCount);
+
+        cout << setw(10) << producerCount
+             << setw(12) << fixed << setprecision(2) << locked
+             << setw(12) << fixed << setprecision(2) << lockFree << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include <showpage/BinaryCodec.h>
+#include <showpage/BlockCompression.h>
+#include <showpage/MappedFile.h>
+
+#include "BeatmapBinary.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace BeatPatterns {
+
+/** Bump the version any time the layout below changes. */
+static const char		BinaryMagic[8] = { 'B', 'P', 'M', 'A', 'P', 'B', 'I', 'N' };
+static const uint32_t	BinaryVersion = 1;
+static const uint32_t	BinaryByteOrder = 0x01020304;
+static const uint32_t	BinaryEndMarker = 0x454E4421;
+
+static const uint32_t	FlagCompressed = 1;
+static const uint32_t	FlagNarrow = 2;
+
+/** Only compress if it saves at least this much. */
+static const double		WorthCompressing = 0.9;
+
+//======================================================================
+// Times.
+//======================================================================
+
+/**
+ * Times go out as a change in ticks from the record before. The reader adds the
+ * changes up and divides, so we do exactly the same here to find out whether it
+ * will get our time back. If it won't (an odd fraction, a huge value, NaN), we
+ * still write a change so the running total stays in step, and say so.
+ */
+static bool
+encodeTime(double time, int64_t &previousTick, int32_t &delta) {
+    double scaled = time * BeatmapBinary::TicksPerBeat;
+    int64_t tick = previousTick;
+
+    if (std::isfinite(scaled) && std::fabs(scaled) < 9007199254740992.0) {
+        tick = std::llround(scaled);
+    }
+    if (tick - previousTick > INT32_MAX || tick - previousTick < INT32_MIN) {
+        tick = previousTick;
+    }
+
+    delta = static_cast<int32_t>(tick - previousTick);
+    previousTick = tick;
+
+    double decoded = static_cast<double>(tick) / BeatmapBinary::TicksPerBeat;
+    return memcmp(&decoded, &time, sizeof(double)) == 0;
+}
+
+static double
+decodeTime(int64_t &previousTick, int32_t delta) {
+    previousTick += delta;
+    return static_cast<double>(previousTick) / BeatmapBinary::TicksPerBeat;
+}
+
+/**
+ * 64-bit FNV-1a, so a damaged file reads as no file rather than as a different
+ * map. We run it over the version string and then the body as written.
+ */
+static uint64_t
+checksum(const char *data, size_t length, uint64_t hash = 0xcbf29ce484222325ULL) {
+    for (size_t index = 0; index < length; ++index) {
+        hash ^= static_cast<unsigned char>(data[index]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static bool
+fitsNarrow(int value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+//======================================================================
+// Records.
+//======================================================================
+
+/** A time that didn't come out exactly in ticks. Notes are numbered first, then events. */
+class TimeException {
+public:
+    uint32_t	record;
+    double		time;
+};
+
+static void
+putField(BinaryWriter &writer, int value, bool narrow) {
+    if (narrow) {
+        writer.put<int8_t>(static_cast<int8_t>(value));
+    }
+    else {
+        writer.put<int32_t>(value);
+    }
+}
+
+static int
+getField(BinaryReader &reader, bool narrow) {
+    return narrow ? reader.get<int8_t>() : reader.get<int32_t>();
+}
+
+static size_t
+noteSize(bool narrow) {
+    return sizeof(int32_t) + 4 * (narrow ? sizeof(int8_t) : sizeof(int32_t));
+}
+
+static size_t
+eventSize(bool narrow) {
+    return sizeof(int32_t) + 2 * (narrow ? sizeof(int8_t) : sizeof(int32_t));
+}
+
+static const size_t ExceptionSize = sizeof(uint32_t) + sizeof(double);
+
+/**
+ * The body: the note records, the event records, then the exceptions.
+ */
+static void
+writeBody(BinaryWriter &writer, const SongBeatmapData &from, bool narrow, std::vector<TimeException> &exceptions) {
+    int64_t tick = 0;
+    int32_t delta = 0;
+    uint32_t record = 0;
+
+    for (const SongBeatmapData::Note &note: from.notes) {
+        if (!encodeTime(note.time, tick, delta)) {
+            exceptions.push_back(TimeException { record, note.time });
+        }
+        writer.put<int32_t>(delta);
+        putField(writer, note.lineIndex, narrow);
+        putField(writer, note.lineLayer, narrow);
+        putField(writer, note.type, narrow);
+        putField(writer, note.cutDirection, narrow);
+        ++record;
+    }
+
+    tick = 0;
+    for (const SongBeatmapData::Event &event: from.events) {
+        if (!encodeTime(event.time, tick, delta)) {
+            exceptions.push_back(TimeException { record, event.time });
+        }
+        writer.put<int32_t>(delta);
+        putField(writer, event.type, narrow);
+        putField(writer, event.value, narrow);
+        ++record;
+    }
+
+    for (const TimeException &exception: exceptions) {
+        writer.put<uint32_t>(exception.record);
+        writer.put<double>(exception.time);
+    }
+}
+
+static bool
+readBody(BinaryReader &reader, SongBeatmapData::Note_Vec &notes, SongBeatmapData::Event_Vec &events,
+         uint32_t exceptionCount, bool narrow)
+{
+    int64_t tick = 0;
+
+    for (SongBeatmapData::Note &note: notes) {
+        note.time = decodeTime(tick, reader.get<int32_t>());
+        note.lineIndex = getField(reader, narrow);
+        note.lineLayer = getField(reader, narrow);
+        note.type = getField(reader, narrow);
+        note.cutDirection = getField(reader, narrow);
+    }
+
+    tick = 0;
+    for (SongBeatmapData::Event &event: events) {
+        event.time = decodeTime(tick, reader.get<int32_t>());
+        event.type = getField(reader, narrow);
+        event.value = getField(reader, narrow);
+    }
+
+    for (uint32_t index = 0; index < exceptionCount; ++index) {
+        uint32_t record = reader.get<uint32_t>();
+        double time = reader.get<double>();
+
+        if (record < notes.size()) {
+            notes[record].time = time;
+        }
+        else if (record - notes.size() < events.size()) {
+            events[record - notes.size()].time = time;
+        }
+        else {
+            return false;
+        }
+    }
+
+    return reader.ok && reader.atEnd();
+}
+
+//======================================================================
+// BeatmapBinary
+//======================================================================
+
+/**
+ * Where the binary copy of this .dat lives.
+ */
+std::string
+BeatmapBinary::sidecarName(const std::string &datFileName) {
+    return datFileName + ".bin";
+}
+
+/**
+ * Write this map. We write a temporary file and rename it into place. Returns false
+ * (and says so) if we couldn't.
+ */
+bool
+BeatmapBinary::save(const SongBeatmapData &from, const std::string &fileName, bool compress) {
+    bool narrow = true;
+    for (const SongBeatmapData::Note &note: from.notes) {
+        narrow = narrow && fitsNarrow(note.lineIndex) && fitsNarrow(note.lineLayer)
+                 && fitsNarrow(note.type) && fitsNarrow(note.cutDirection);
+    }
+    for (const SongBeatmapData::Event &event: from.events) {
+        narrow = narrow && fitsNarrow(event.type) && fitsNarrow(event.value);
+    }
+
+    BinaryWriter body;
+    std::vector<TimeException> exceptions;
+    body.bytes.reserve(from.notes.size() * noteSize(narrow) + from.events.size() * eventSize(narrow));
+    writeBody(body, from, narrow, exceptions);
+
+    uint32_t flags = narrow ? FlagNarrow : 0;
+    string compressed;
+    if (compress) {
+        compressed = BlockCompression::compress(body.bytes.data(), body.bytes.size());
+        if (compressed.size() < body.bytes.size() * WorthCompressing) {
+            flags |= FlagCompressed;
+        }
+    }
+    const string & stored = (flags & FlagCompressed) ? compressed : body.bytes;
+
+    BinaryWriter writer;
+    writer.bytes.reserve(stored.size() + 128);
+    writer.bytes.append(BinaryMagic, sizeof(BinaryMagic));
+    writer.put<uint32_t>(BinaryVersion);
+    writer.put<uint32_t>(BinaryByteOrder);
+    writer.put<uint32_t>(flags);
+    writer.put<uint32_t>(TicksPerBeat);
+    writer.putString(from.version);
+    writer.put<uint32_t>(static_cast<uint32_t>(from.notes.size()));
+    writer.put<uint32_t>(static_cast<uint32_t>(from.events.size()));
+    writer.put<uint32_t>(static_cast<uint32_t>(exceptions.size()));
+    writer.put<uint64_t>(body.bytes.size());
+    writer.put<uint64_t>(stored.size());
+    writer.put<uint64_t>(checksum(body.bytes.data(), body.bytes.size(), checksum(from.version.data(), from.version.size())));
+    writer.bytes.append(stored);
+    writer.put<uint32_t>(BinaryEndMarker);
+
+    string tempName = fileName + ".tmp";
+    std::ofstream output(tempName, std::ios::binary | std::ios::trunc);
+    output.write(writer.bytes.data(), static_cast<std::streamsize>(writer.bytes.size()));
+    output.close();
+
+    if (!output || std::rename(tempName.c_str(), fileName.c_str()) != 0) {
+        cout << "Unable to write beatmap " << fileName << endl;
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read a map we wrote. Returns false, leaving into alone, if the file isn't there
+ * or isn't one of ours.
+ */
+bool
+BeatmapBinary::load(SongBeatmapData &into, const std::string &fileName) {
+    MappedFile file;
+    if (!file.open(fileName) || file.size() == 0) {
+        return false;
+    }
+
+    const char * contents = file.data();
+    size_t length = file.size();
+    BinaryReader reader(contents, length);
+    bool valid = false;
+
+    string version;
+    SongBeatmapData::Note_Vec notes;
+    SongBeatmapData::Event_Vec events;
+
+    char magic[sizeof(BinaryMagic)];
+    for (char &ch: magic) {
+        ch = reader.get<char>();
+    }
+
+    if (memcmp(magic, BinaryMagic, sizeof(BinaryMagic)) == 0
+        && reader.get<uint32_t>() == BinaryVersion
+        && reader.get<uint32_t>() == BinaryByteOrder)
+    {
+        uint32_t flags = reader.get<uint32_t>();
+        uint32_t ticksPerBeat = reader.get<uint32_t>();
+        version = reader.getString();
+        uint32_t noteCount = reader.get<uint32_t>();
+        uint32_t eventCount = reader.get<uint32_t>();
+        uint32_t exceptionCount = reader.get<uint32_t>();
+        uint64_t bodyLength = reader.get<uint64_t>();
+        uint64_t storedLength = reader.get<uint64_t>();
+        uint64_t bodyChecksum = reader.get<uint64_t>();
+
+        bool narrow = (flags & FlagNarrow) != 0;
+
+        // The counts tell us how long the body has to be, so a damaged header
+        // can't have us allocate something silly.
+        uint64_t expected = static_cast<uint64_t>(noteCount) * noteSize(narrow)
+                            + static_cast<uint64_t>(eventCount) * eventSize(narrow)
+                            + static_cast<uint64_t>(exceptionCount) * ExceptionSize;
+
+        // What's left is the stored body and the end marker.
+        size_t headerLength = sizeof(BinaryMagic) + 8 * sizeof(uint32_t) + version.size() + 3 * sizeof(uint64_t);
+
+        valid = reader.ok && (flags & ~(FlagCompressed | FlagNarrow)) == 0
+                && ticksPerBeat == static_cast<uint32_t>(TicksPerBeat) && bodyLength == expected
+                && storedLength <= length && headerLength + storedLength + sizeof(uint32_t) == length;
+
+        if (valid) {
+            const char * stored = contents + headerLength;
+            BinaryReader tail(stored + storedLength, sizeof(uint32_t));
+            valid = tail.get<uint32_t>() == BinaryEndMarker;
+
+            std::vector<char> buffer;
+            const char * body = stored;
+
+            if (valid && (flags & FlagCompressed) != 0) {
+                buffer.resize(static_cast<size_t>(bodyLength));
+                valid = BlockCompression::decompress(stored, static_cast<size_t>(storedLength), buffer.data(), buffer.size());
+                body = buffer.data();
+            }
+            else if (valid) {
+                valid = storedLength == bodyLength;
+            }
+
+            if (valid) {
+                valid = checksum(body, static_cast<size_t>(bodyLength), checksum(version.data(), version.size())) == bodyChecksum;
+            }
+
+            if (valid) {
+                notes.resize(noteCount);
+                events.resize(eventCount);
+
+                BinaryReader bodyReader(body, static_cast<size_t>(bodyLength));
+                valid = readBody(bodyReader, notes, events, exceptionCount, narrow);
+            }
+        }
+    }
+
+    file.close();
+
+    if (!valid) {
+        return false;
+    }
+
+    into.version = version;
+    into.notes.swap(notes);
+    into.events.swap(events);
+
+    return true;
+}
+
+} // namespace BeatPatterns
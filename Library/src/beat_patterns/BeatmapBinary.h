@@ -0,0 +1,37 @@
+#ifndef BEATMAPBINARY_H
+#define BEATMAPBINARY_H
+
+#include <string>
+
+#include "Song.h"
+
+namespace BeatPatterns {
+
+/**
+ * A compact binary copy of a SongBeatmapData, kept beside the .dat (Foo.dat.bin)
+ * for when a map goes through several load / save cycles before anyone plays it.
+ * It holds everything the .dat does, so saving it back as JSON gives exactly the
+ * .dat we'd have written in the first place.
+ *
+ * After a short header, notes and events are fixed-width records. Times are
+ * stored as the change in ticks (TicksPerBeat to the beat) from the record
+ * before, which is small and repetitive. Any time that isn't exactly a whole
+ * number of ticks is kept in full in an exceptions list. If every field fits in
+ * a byte we use narrow records, and if it's worth it, the records are compressed
+ * with BlockCompression.
+ *
+ * Reading goes through MappedFile and decodes straight out of the file's contents.
+ */
+class BeatmapBinary {
+public:
+    static const int TicksPerBeat = 960;
+
+    static std::string sidecarName(const std::string &datFileName);
+
+    static bool load(SongBeatmapData &into, const std::string &fileName);
+    static bool save(const SongBeatmapData &from, const std::string &fileName, bool compress = true);
+};
+
+} // namespace BeatPatterns
+
+#endif // BEATMAPBINARY_H
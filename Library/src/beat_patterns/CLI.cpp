@@ -1,12 +1,20 @@
 #include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
 
 #include <boost/filesystem.hpp>
 #include <showpage/OptionHandler.h>
 #include <showpage/FileUtilities.h>
+#include <showpage/Profiler.h>
+#include <showpage/ThreadPool.h>
 
 #include "CLI.h"
 #include "Preferences.h"
 #include "Generator.h"
+#include "SongIndex.h"
 
 using std::cout;
 using std::cerr;
@@ -15,6 +23,21 @@ using std::string;
 
 namespace BeatPatterns {
 
+/**
+ * For --format.
+ */
+static BeatmapFormat
+toFormat(const string &value) {
+    if (value == "bin" || value == "binary") {
+        return BeatmapFormat::Binary;
+    }
+    if (value != "json") {
+        cerr << "Unknown format " << value << ". Use bin or json." << endl;
+        exit(1);
+    }
+    return BeatmapFormat::JSON;
+}
+
 /**
  * Constructor.
  */
@@ -48,6 +71,18 @@ CLI::parseArgs(int argc, char **argv) {
         // Specific to --generate
         { "generate",   no_argument, [=](const char *) { generate = true; }},
         { "difficulty", required_argument, [=](const char *arg) { difficulty = toLevelDifficulty(arg); }},
+        { "jobs",       required_argument, [=](const char *arg) { jobs = atoi(arg); }},
+        { "seed",       required_argument, [=](const char *arg) { seed = strtoull(arg, nullptr, 10); haveSeed = true; }},
+        { "format",     required_argument, [=](const char *arg) { format = toFormat(arg); formatGiven = true; }},
+        { "batch",      required_argument, [=](const char *arg) { batchDir = arg; }},
+        { "library",    no_argument, [=](const char *) { batchDir = Preferences::getLibraryPath(); }},
+
+        // Library index
+        { "list",       no_argument, [=](const char *) { list = true; }},
+        { "search",     required_argument, [=](const char *arg) { list = true; searchText = arg; }},
+        { "reindex",    no_argument, [=](const char *) { list = true; reindex = true; }},
+
+        { "profile",    no_argument, [=](const char *) { profile = true; Profiler::setEnabled(true); }},
         {nullptr}
     };
 
@@ -81,6 +116,23 @@ CLI::usage(const char *progName) {
          << "\n"
          << " --generate           Generate one or more maps.\n"
          << " --difficulty hard    Easy, Normal, Hard, Expert, Expert+, or All.\n"
+         << " --jobs n             With --difficulty All, generate up to n difficulties at once.\n"
+         << " --seed n             Seed the generator. The same song, difficulty and seed produce the same map.\n"
+         << " --format json        How to save the maps: json (the .dat files) or bin (a compact copy beside\n"
+         << "                      each .dat, for maps you'll work on more before playing). Saving as json\n"
+         << "                      later writes the .dat from the binary copy. With no --generate or --update,\n"
+         << "                      this rewrites the song's existing maps in that format.\n"
+         << "\n"
+         << " --batch directory    Generate every song (each directory with an info.dat) under this directory.\n"
+         << " --library            Same as --batch with your library path.\n"
+         << "                      --difficulty and --seed apply to every song. --jobs sets how many songs\n"
+         << "                      at once; the default is one per core.\n"
+         << "\n"
+         << " --list               List the songs in your library, from the library's index.\n"
+         << " --search text        List the songs whose name, artist, mapper or directory contain this text.\n"
+         << " --reindex            Bring the index up to date first. Only changed songs are read again.\n"
+         << "\n"
+         << " --profile            When done, print how long each phase took and what we counted, as JSON.\n"
          << "\n"
          << "The song directory can be the info.dat file or the containing directory.\n"
          ;
@@ -91,11 +143,28 @@ CLI::usage(const char *progName) {
  */
 void
 CLI::run() {
+    if (jobs > 0) {
+        ThreadPool::setSharedThreadCount(static_cast<size_t>(jobs));
+    }
+
     if (init) {
         doInit();
         return;
     }
 
+    if (list) {
+        doList();
+        return;
+    }
+
+    if (batchDir.length() > 0) {
+        doBatch();
+        reportProfile();
+        return;
+    }
+
+    song.saveFormat = format;
+
     if (createNew) {
         doCreate();
     }
@@ -127,6 +196,12 @@ CLI::run() {
     if (generate) {
         doGenerate();
     }
+
+    if (formatGiven && !update && !generate && !createNew) {
+        doConvert();
+    }
+
+    reportProfile();
 }
 
 /**
@@ -217,41 +292,239 @@ CLI::doUpdate() {
 void
 CLI::doGenerate() {
     cout << "Doing generate.\n";
-    if (difficulty == LevelDifficulty::All) {
-        doGenerateFor(LevelDifficulty::Easy);
-        doGenerateFor(LevelDifficulty::Normal);
-        doGenerateFor(LevelDifficulty::Hard);
-        doGenerateFor(LevelDifficulty::Expert);
-        doGenerateFor(LevelDifficulty::ExpertPlus);
-    }
-    else {
-        doGenerateFor(difficulty);
+
+    // Song isn't thread-safe, so find or create every map and build the
+    // generators here. After this, each generator only touches its own map.
+    PointerVector<Generator> generators;
+    for (LevelDifficulty thisDifficulty: difficultiesToGenerate()) {
+        generators.push_back(createGeneratorFor(song, thisDifficulty));
     }
 
+    runGenerators(generators, jobs > 1, true);
+
     song.save();
 }
 
-void CLI::doGenerateFor(LevelDifficulty thisDifficulty) {
-    cout << "Generate for difficulty: " << thisDifficulty << endl;
+/**
+ * Read every map the song has and save it in the format we were given.
+ */
+void
+CLI::doConvert() {
+    cout << "Converting maps.\n";
+
+    for (SongDifficultySet *set: song.info.getDifficultySets()) {
+        for (SongDifficulty *songDifficulty: set->difficulties) {
+            song.getBeatmap(songDifficulty->beatmapFilename);
+        }
+    }
+
+    song.save();
+}
 
-    SongDifficulty * songDifficulty = song.getDifficulty(thisDifficulty);
-    SongBeatmapData * beatmapData = song.getBeatmap(songDifficulty->beatmapFilename);
+/**
+ * Generate every song under batchDir. We load the preferences and patterns once,
+ * then each thread in the pool takes the next song, generates all its difficulties,
+ * saves it, and lets it go. So we never hold more songs open than we have threads.
+ */
+void
+CLI::doBatch() {
+    std::vector<string> songDirs;
 
-    if (songDifficulty == nullptr) {
-        cout << "Null songDifficulty.\n";
+    boost::filesystem::path root(batchDir);
+    if (!boost::filesystem::is_directory(root)) {
+        cerr << "Cannot find the batch directory " << batchDir << endl;
         exit(1);
     }
-    if (beatmapData == nullptr) {
-        cout << "Null beatmapData.\n";
-        exit(1);
+
+    boost::filesystem::recursive_directory_iterator end_iter;
+    for ( boost::filesystem::recursive_directory_iterator dir_itr( root ); dir_itr != end_iter; ++dir_itr ) {
+        boost::filesystem::path childPath = dir_itr->path();
+        if (childPath.filename().string() == "info.dat") {
+            songDirs.push_back(childPath.parent_path().string());
+        }
+    }
+    std::sort(songDirs.begin(), songDirs.end());
+
+    ThreadPool & pool = ThreadPool::shared();
+    size_t threadCount = std::min(pool.size(), std::max(songDirs.size(), static_cast<size_t>(1)));
+
+    cout << "Batch generate of " << songDirs.size() << " songs using " << threadCount << " threads.\n";
+
+    // Make sure the patterns are loaded before anyone races for them.
+    Preferences::getPatterns();
+
+    std::atomic<size_t> songsDone(0);
+    std::atomic<size_t> songsFailed(0);
+    std::atomic<size_t> notesGenerated(0);
+    std::mutex outputMutex;
+    std::vector<LevelDifficulty> difficulties = difficultiesToGenerate();
+
+    // A song we can't read or write is counted and skipped; the rest of the batch carries on.
+    auto generateSong = [&](size_t index) {
+        const string & songDir = songDirs.at(index);
+
+        try {
+            Song batchSong;
+
+            // Pool threads share cout, so only the lines below, under outputMutex, get printed.
+            batchSong.verbose = false;
+            if (batchSong.open(songDir) != 0) {
+                std::unique_lock<std::mutex> lock(outputMutex);
+                cerr << "Song failed to open: " << songDir << endl;
+                ++songsFailed;
+                return;
+            }
+            batchSong.saveFormat = format;
+
+            PointerVector<Generator> generators;
+            for (LevelDifficulty thisDifficulty: difficulties) {
+                generators.push_back(createGeneratorFor(batchSong, thisDifficulty));
+            }
+
+            // One song per thread, so its difficulties go one at a time.
+            runGenerators(generators, false, false);
+            batchSong.save();
+
+            size_t noteCount = 0;
+            for (LevelDifficulty thisDifficulty: difficulties) {
+                SongDifficulty * songDifficulty = batchSong.createDifficulty(thisDifficulty);
+                noteCount += batchSong.getBeatmap(songDifficulty->beatmapFilename)->notes.size();
+            }
+            notesGenerated += noteCount;
+            ++songsDone;
+
+            std::unique_lock<std::mutex> lock(outputMutex);
+            cout << "Generated " << songDir << ": " << noteCount << " notes" << endl;
+        }
+        catch (const std::exception &e) {
+            std::unique_lock<std::mutex> lock(outputMutex);
+            cerr << "Song failed: " << songDir << ": " << e.what() << endl;
+            ++songsFailed;
+        }
+        catch (...) {
+            std::unique_lock<std::mutex> lock(outputMutex);
+            cerr << "Song failed: " << songDir << endl;
+            ++songsFailed;
+        }
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Songs vary a lot in length, so hand them out one at a time.
+    pool.parallel_for(0, songDirs.size(), generateSong, 1);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (seconds <= 0.0) {
+        seconds = 1e-9;
+    }
+
+    cout << "Batch done: " << songsDone << " songs (" << songsFailed << " failed), "
+         << notesGenerated << " notes in " << seconds << " seconds.\n"
+         << "    " << (songsDone / seconds) << " songs/sec, "
+         << (notesGenerated / seconds) << " notes/sec.\n";
+}
+
+/**
+ * Print the songs in the library index that match searchText. We update the
+ * index first if they asked, or if there isn't one yet.
+ */
+void
+CLI::doList() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    SongIndex index(Preferences::getLibraryPath());
+    if (!index.load() || reindex) {
+        index.refresh(jobs > 0 ? static_cast<size_t>(jobs) : 0);
+        index.save();
+    }
+
+    std::vector<const SongIndex::Entry *> matches = index.search(searchText);
+
+    double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    for (const SongIndex::Entry *entry: matches) {
+        cout << entry->path.substr(entry->path.empty() ? 0 : 1)
+             << ": " << entry->songName << " by " << entry->songAuthorName
+             << " (" << entry->beatsPerMinute << " BPM)";
+        for (const SongIndex::Difficulty &difficulty: entry->difficulties) {
+            cout << " " << difficulty.difficulty;
+        }
+        cout << endl;
     }
 
-    cout << "Create the generator.\n";
-    Generator generator(song, *songDifficulty, *beatmapData);
-    cout << "Run the generator.\n";
-    generator.generateEntireSong();
+    cout << matches.size() << " of " << index.getEntries().size() << " songs. Read "
+         << index.getLastReadCount() << " info.dat files in " << millis << " ms.\n";
+}
+
+/**
+ * For --profile: what the Profiler recorded, as JSON.
+ */
+void
+CLI::reportProfile() {
+    if (profile) {
+        cout << Profiler::toJSON().dump(2) << endl;
+    }
+}
+
+/**
+ * Which difficulties did they ask for?
+ */
+std::vector<LevelDifficulty>
+CLI::difficultiesToGenerate() const {
+    std::vector<LevelDifficulty> difficulties;
+    if (difficulty == LevelDifficulty::All) {
+        difficulties = { LevelDifficulty::Easy, LevelDifficulty::Normal, LevelDifficulty::Hard,
+                         LevelDifficulty::Expert, LevelDifficulty::ExpertPlus };
+    }
+    else {
+        difficulties.push_back(difficulty);
+    }
+    return difficulties;
+}
+
+/**
+ * Build the generator for this difficulty, creating the difficulty if the song doesn't have it yet.
+ */
+Generator *
+CLI::createGeneratorFor(Song &forSong, LevelDifficulty thisDifficulty) {
+    SongDifficulty * songDifficulty = forSong.createDifficulty(thisDifficulty);
+    SongBeatmapData * beatmapData = forSong.getBeatmap(songDifficulty->beatmapFilename);
+
+    Generator * generator = new Generator(forSong, *songDifficulty, *beatmapData);
+    if (haveSeed) {
+        generator->setSeed(seed);
+    }
+
+    if (forSong.verbose) {
+        cout << "Create the generator for difficulty: " << thisDifficulty << " with seed " << generator->getSeed() << endl;
+    }
+    return generator;
+}
+
+/**
+ * Run these generators, either one after the other or across the shared thread pool.
+ * Each one works on its own SongBeatmapData, so they don't need to coordinate. We
+ * return once they're all done. Batch runs pass verbose false to keep their output tidy.
+ */
+void
+CLI::runGenerators(PointerVector<Generator> &generators, bool inParallel, bool verbose) {
+    auto generate = [&](size_t index) {
+        Generator * generator = generators.at(index);
+
+        generator->generateEntireSong();
+        if (verbose) {
+            cout << "Generate done for difficulty: " << generator->getLevelDifficulty() << endl;
+        }
+    };
+
+    if (!inParallel || generators.size() <= 1) {
+        for (size_t index = 0; index < generators.size(); ++index) {
+            generate(index);
+        }
+        return;
+    }
 
-    cout << "Generate done for difficulty: " << thisDifficulty << endl;
+    ThreadPool::shared().parallel_for(0, generators.size(), generate, 1);
 }
 
 
@@ -2,11 +2,16 @@
 #define CLI_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
+
 #include "Common.h"
 #include "Song.h"
 
 namespace BeatPatterns {
 
+class Generator;
+
 /**
  * This defines our CLI.
  */
@@ -23,6 +28,28 @@ private:
 
     LevelDifficulty	difficulty = LevelDifficulty::All;
 
+    /** How many difficulties (or with --batch, songs) to generate at once. 0 means we pick. */
+    int				jobs = 0;
+
+    /** If set, generate reproducibly from this seed. */
+    bool			haveSeed = false;
+    uint64_t		seed = 0;
+
+    /** For --format: how we save the beatmaps. On its own, it converts the song's maps. */
+    BeatmapFormat	format = BeatmapFormat::JSON;
+    bool			formatGiven = false;
+
+    /** For --batch or --library, generate every song under here. */
+    std::string		batchDir;
+
+    /** For --list or --search, show the songs in the library index. */
+    bool			list = false;
+    bool			reindex = false;
+    std::string		searchText;
+
+    /** For --profile, print where the time went when we're done. */
+    bool			profile = false;
+
     // These are the various commands we can perform.
     bool			init = false;
     bool			createNew = false;
@@ -35,7 +62,13 @@ private:
     void doCreate();
     void doUpdate();
     void doGenerate();
-    void doGenerateFor(LevelDifficulty thisDifficulty);
+    void doConvert();
+    void doBatch();
+    void doList();
+    void reportProfile();
+    std::vector<LevelDifficulty> difficultiesToGenerate() const;
+    Generator * createGeneratorFor(Song &forSong, LevelDifficulty thisDifficulty);
+    void runGenerators(PointerVector<Generator> &generators, bool inParallel, bool verbose);
 
     std::string copyIfNecessary(const std::string & from);
 
@@ -1,6 +1,9 @@
 #include <iostream>
+#include <algorithm>
 #include <math.h>
 
+#include <showpage/Profiler.h>
+
 #include "Generator.h"
 
 using std::cout;
@@ -8,16 +11,9 @@ using std::endl;
 
 namespace BeatPatterns {
 
-/**
- * Return a random number between these two values.
- */
-static double randomValue(double a, double b) {
-    double random = rand() /  RAND_MAX;
-    double diff = b - a;
-    double r = random * diff;
-
-    return a + r;
-}
+/** For --profile. */
+static Profiler::Counter patternsEvaluated("patternsEvaluated");
+static Profiler::Counter notesEmitted("notesEmitted");
 
 /**
  * Constructor.
@@ -32,52 +28,192 @@ Generator::Generator(Song &_song, SongDifficulty &_difficulty, SongBeatmapData &
     maximumDelayBetweenPatterns = difficultyDefaults.maximumDelayBetweenPatterns;
 
     song.fixBeatDuration();
+    setSeed(Random::randomSeed());
+}
+
+/**
+ * Seed our random number generator. We mix in the difficulty so each difficulty of
+ * a song gets its own sequence, and the result doesn't depend on which order (or
+ * which threads) the difficulties were generated in.
+ */
+Generator &
+Generator::setSeed(uint64_t value) {
+    seed = value;
+    random.seed(value ^ (static_cast<uint64_t>(difficulty.difficulty) * 0x9E3779B97F4A7C15ULL));
+    return *this;
 }
 
 /**
  * This version performs a generation for the entire song, throwing out anything we'd done before.
  */
 void Generator::generateEntireSong() {
-    beatmapData.hasChanged = true;
-    beatmapData.notes.eraseAll();
+    Profiler::Scope scope("generate", levelDifficultyToString(difficulty.difficulty));
+
+    blueSaberLocation.reset();
+    redSaberLocation.reset();
+    scratch.clear();
+
+    // Size scratch once, so the loop below never has to grow it. Maps rarely have
+    // more notes than the song has beats, and the map we're replacing is a good
+    // guess too.
+    size_t beats = song.beatDurationSeconds > 0.0 ? static_cast<size_t>(song.duration / song.beatDurationSeconds) : 0;
+    scratch.reserve(std::max(beats, beatmapData.notes.size()));
 
     // We need to calculate the beat number for the first note. We begin with the minimum
     // white space, then we round up to the nearest whole beat.
     timeOfFirstNote = minimumInitialWhitespace;
     beatNumber = std::ceil(timeOfFirstNote / song.beatDurationSeconds);
     currentTime = beatNumber * song.beatDurationSeconds;
-    remainingDuration = song.duration - currentTime;
+
+    generateUntilDone(song.duration);
+    spliceScratch(0, beatmapData.notes.size());
 }
 
 /**
- * This version is used to generate only over a range.
+ * This version is used to generate only over a range. Notes that share a time with
+ * either end note are kept too, so we don't split up a pair of cubes.
  */
-void Generator::generateRange(int beatStart, int beatEnd) {
+void Generator::generateRange(int startingIndex, int endingIndex) {
+    SongBeatmapData::Note_Vec & notes = beatmapData.notes;
+    int count = static_cast<int>(notes.size());
+
+    if (startingIndex < -1 || endingIndex > count || startingIndex >= endingIndex) {
+        cout << "generateRange: bad range " << startingIndex << " to " << endingIndex << endl;
+        return;
+    }
+
+    scratch.clear();
+
+    // The notes are sorted by time, so find the block we're replacing with two binary searches.
+    auto byTime = [](const SongBeatmapData::Note &note, double time) { return note.time < time; };
+    auto byTimeUpper = [](double time, const SongBeatmapData::Note &note) { return time < note.time; };
+
+    size_t fromIndex = 0;
+    if (startingIndex >= 0) {
+        double startBeat = notes[startingIndex].time;
+        fromIndex = std::upper_bound(notes.begin(), notes.end(), startBeat, byTimeUpper) - notes.begin();
+
+        currentTime = (startBeat * song.beatDurationSeconds) + random.between(minimumDelayBetweenPatterns, maximumDelayBetweenPatterns);
+    }
+    else {
+        currentTime = minimumInitialWhitespace;
+    }
+    beatNumber = std::ceil(currentTime / song.beatDurationSeconds);
+    currentTime = beatNumber * song.beatDurationSeconds;
+
+    size_t toIndex = notes.size();
+    double endTime = song.duration;
+    double endBeat = 0.0;
+    if (endingIndex < count) {
+        endBeat = notes[endingIndex].time;
+        toIndex = std::lower_bound(notes.begin(), notes.end(), endBeat, byTime) - notes.begin();
+        endTime = endBeat * song.beatDurationSeconds - minimumDelayBetweenPatterns;
+    }
+    if (toIndex < fromIndex) {
+        toIndex = fromIndex;
+    }
+
+    replayLocationsBefore(fromIndex);
+    generateUntilDone(endTime);
+
+    // A pattern can run long. Don't let it run into the notes we're keeping.
+    if (endingIndex < count) {
+        auto firstPast = std::lower_bound(scratch.begin(), scratch.end(), endBeat, byTime);
+        scratch.erase(firstPast, scratch.end());
+    }
+
+    spliceScratch(fromIndex, toIndex);
 }
 
 /**
  * This method gets called after we've figured out what we're doing. Call this to actually iterate over generation.
+ * The caller sets beatNumber and currentTime for the first pattern. We fill scratch until we run out of time.
  */
 void
-Generator::generateUntilDone() {
-    blueSaberLocation.reset();
-    redSaberLocation.reset();
+Generator::generateUntilDone(double endTime) {
+    patternIndex = Preferences::getPatterns().getIndex(difficulty.difficulty, song.info.beatsPerMinute);
+    remainingDuration = endTime - currentTime;
 
     while (remainingDuration > 0.5) {
-        pickAndApplyPattern(beatmapData, -1, beatNumber, remainingDuration);
+        size_t before = scratch.size();
+        pickAndApplyPattern(beatNumber, remainingDuration);
+        Profiler::count(patternsEvaluated);
+        Profiler::count(notesEmitted, scratch.size() - before);
+        if (scratch.size() == before) {
+            break;
+        }
 
-        SongBeatmapData::Note & mostRecentNote = *beatmapData.notes.back();
+        SongBeatmapData::Note & mostRecentNote = scratch.back();
 
         // Start time of the next pattern.
         // This doesn't support patternSnapTo yet.
-        currentTime = (mostRecentNote.time * song.beatDurationSeconds) + randomValue(minimumDelayBetweenPatterns, maximumDelayBetweenPatterns);
+        currentTime = (mostRecentNote.time * song.beatDurationSeconds) + random.between(minimumDelayBetweenPatterns, maximumDelayBetweenPatterns);
         beatNumber = std::ceil(currentTime / song.beatDurationSeconds);
 
         currentTime = beatNumber * song.beatDurationSeconds;
-        remainingDuration = song.duration - currentTime;
+        remainingDuration = endTime - currentTime;
     }
 }
 
+/**
+ * Before generating in the middle of a song, put the sabers where the notes before
+ * the range left them.
+ */
+void
+Generator::replayLocationsBefore(size_t index) {
+    blueSaberLocation.reset();
+    redSaberLocation.reset();
+
+    bool haveBlue = false;
+    bool haveRed = false;
+    int blueType = cubeTypeToInt(CubeType::Blue);
+    int redType = cubeTypeToInt(CubeType::Red);
+
+    while (index > 0 && !(haveBlue && haveRed)) {
+        const SongBeatmapData::Note & note = beatmapData.notes[--index];
+        if (!haveBlue && note.type == blueType) {
+            blueSaberLocation.apply(note, note.time);
+            haveBlue = true;
+        }
+        else if (!haveRed && note.type == redType) {
+            redSaberLocation.apply(note, note.time);
+            haveRed = true;
+        }
+    }
+}
+
+/**
+ * Replace notes[fromIndex, toIndex) with whatever's in scratch. We overwrite the
+ * overlap in place, then do a single insert or erase for the difference, so the
+ * tail of the map moves at most once.
+ *
+ * Replacing the whole map, we just trade buffers: the map takes scratch, and we
+ * keep the old notes' storage for next time.
+ */
+void
+Generator::spliceScratch(size_t fromIndex, size_t toIndex) {
+    SongBeatmapData::Note_Vec & notes = beatmapData.notes;
+
+    if (fromIndex == 0 && toIndex == notes.size()) {
+        notes.swap(scratch);
+    }
+    else {
+        size_t replacing = toIndex - fromIndex;
+        size_t overlap = std::min(replacing, scratch.size());
+
+        std::copy(scratch.begin(), scratch.begin() + overlap, notes.begin() + fromIndex);
+        if (scratch.size() > replacing) {
+            notes.insert(notes.begin() + toIndex, scratch.begin() + overlap, scratch.end());
+        }
+        else {
+            notes.erase(notes.begin() + fromIndex + overlap, notes.begin() + toIndex);
+        }
+    }
+
+    scratch.clear();
+    beatmapData.markChanged();
+}
+
 /**
  * This picks an appropriate pattern and applies it. Various constraints.
  *
@@ -90,29 +226,17 @@ Generator::generateUntilDone() {
  * 		ended, the more wriggle room we allow. This is modifed by difficulty level.
  *
  */
-int
-Generator::pickAndApplyPattern(SongBeatmapData &output, int atIndex, double beatNumber, double maxDuration) {
-    Pattern_Vec		patterns(false);
-    Pattern *		pattern = nullptr;
-
-    possiblePatterns(patterns, maxDuration);
-    pattern = patterns.selectPattern(difficulty.difficulty);
+void
+Generator::pickAndApplyPattern(double beatNumber, double maxDuration) {
+    Pattern *		pattern = possiblePatterns(maxDuration).sample(random);
 
-    // This shouldn't happen, but if it does...
+    // No usable patterns at this difficulty. Add nothing, which stops the generator.
     if (pattern == nullptr) {
-        if (patterns.size() > 0) {
-            pattern = patterns.at(0);
-        }
-        else {
-            pattern = Preferences::getPatterns().at(0);
-        }
-    }
-
-    // Now we begin to apply it.
-    if (pattern->isTransformation()) {
-        pattern = pattern->getTransformation();
+        return;
     }
 
+    // Now we begin to apply it. Transformations step like their source but we
+    // place the notes from their precompiled, flattened copy.
     int lineLayer = 0;
     int lineIndex = 2;
     double stepBy = pattern->stepByFor(difficulty.difficulty, song.info.beatsPerMinute);
@@ -121,56 +245,38 @@ Generator::pickAndApplyPattern(SongBeatmapData &output, int atIndex, double beat
         stepBy = 1.0;
     }
 
-    pattern->getStartingLocation(lineLayer, lineIndex);
+    const Pattern * flat = pattern->getTransformation();
 
-    auto position = output.notes.begin();
-    position += atIndex;
+    flat->getStartingLocation(random, lineLayer, lineIndex, redSaberLocation, blueSaberLocation);
 
-    for (NoteSet & noteSet: pattern->noteSequence) {
-        for (Note & note: noteSet) {
-            SongBeatmapData::Note * newNote = new SongBeatmapData::Note();
+    for (const NoteSet & noteSet: flat->noteSequence) {
+        for (const Note & note: noteSet) {
+            SongBeatmapData::Note newNote;
 
-            newNote->time = beatNumber;
-            newNote->type = cubeTypeToInt(note.cubeType);
-            newNote->cutDirection = cutDirectionToInt(note.cutDirection);
-            newNote->lineIndex = lineIndex + note.relativeX;
-            newNote->lineLayer = lineLayer + note.relativeY;
+            newNote.time = beatNumber;
+            newNote.type = cubeTypeToInt(note.cubeType);
+            newNote.cutDirection = cutDirectionToInt(note.cutDirection);
+            newNote.lineIndex = lineIndex + note.relativeX;
+            newNote.lineLayer = lineLayer + note.relativeY;
 
             if (note.cubeType == CubeType::Blue) {
-                this->blueSaberLocation.apply(*newNote, beatNumber);
+                this->blueSaberLocation.apply(newNote, beatNumber);
             }
             else if (note.cubeType == CubeType::Red) {
-                this->redSaberLocation.apply(*newNote, beatNumber);
+                this->redSaberLocation.apply(newNote, beatNumber);
             }
 
-            if (atIndex == -1) {
-                beatmapData.notes.push_back(newNote);
-            }
-            else {
-                beatmapData.notes.insert(position++, newNote);
-                ++atIndex;
-            }
+            scratch.push_back(newNote);
         }
 
         // Set to the next location.
         beatNumber += stepBy;
     }
-
-    // Make sure our next pattern starts on the next beat and isn't insanely close.
-    // This is a little arbitrary, and I'll have to see how it works. I may want to
-    // add another value to the pattern that helps calculate this.
-    double nextBeatNumber = ceil(beatNumber);
-    if (nextBeatNumber - beatNumber < (stepBy * 2.0)) {
-        nextBeatNumber += 1.0;
-    }
-    beatNumber = nextBeatNumber;
-
-    return atIndex - 1;
 }
 
 /**
- * Get the patterns we might use for the current level difficulty.
- * For now, I'm ignoring max duration.
+ * Get the patterns we might use for the current level difficulty that are no
+ * longer than maxDuration seconds.
  *
  * I exclude patterns that do not flow well from the current location and inertia.
  * Rules:
@@ -179,15 +285,14 @@ Generator::pickAndApplyPattern(SongBeatmapData &output, int atIndex, double beat
  *		pattern with a similar initial direction below Hard level.
  *
  *  2. Don't pick a pattern that starts in the current location.
+ *
+ * The PatternIndex has already sorted the candidates out by saber location and
+ * length (see Pattern::compatibleWithSaberLocations), so this is a table lookup.
+ * If nothing flows, we get everything that fits.
  */
-void
-Generator::possiblePatterns(Pattern_Vec &vec, double ) {
-    for (Pattern *pattern: Preferences::getPatterns()) {
-        int weight = pattern->getWeight(difficulty.difficulty);
-        if (weight > 0) {
-            vec.push_back(pattern);
-        }
-    }
+const PatternSampler &
+Generator::possiblePatterns(double maxDuration) const {
+    return patternIndex->lookup(redSaberLocation, blueSaberLocation, maxDuration / song.beatDurationSeconds);
 }
 
 
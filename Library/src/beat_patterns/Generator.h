@@ -5,6 +5,7 @@
 #include "Pattern.h"
 #include "Preferences.h"
 #include "SaberLocation.h"
+#include "Random.h"
 
 namespace BeatPatterns {
 
@@ -124,6 +125,10 @@ private:
     double	minimumDelayBetweenPatterns = 0.05;
     double	maximumDelayBetweenPatterns = 4.0;
 
+    /** Our own random numbers, so generators can run in parallel and be reproduced. */
+    Random		random;
+    uint64_t	seed = 0;
+
     //----------------------------------------------------------------------
     // These are fields about the current status.
     //----------------------------------------------------------------------
@@ -134,33 +139,49 @@ private:
     /** This is where we think the red saber is. */
     SaberLocation redSaberLocation;
 
+    /** Our candidate patterns, by where the sabers are. Picked up at the start of each run. */
+    std::shared_ptr<const PatternIndex> patternIndex;
+
     double timeOfFirstNote;
     double beatNumber;
     double currentTime;
     double remainingDuration;
 
+    /**
+     * New notes land here first, then get spliced into the beatmap in one go. We keep
+     * it (or the buffer it traded places with) between runs, so generating again
+     * doesn't allocate.
+     */
+    SongBeatmapData::Note_Vec scratch;
+
     //----------------------------------------------------------------------
     // Methods.
     //----------------------------------------------------------------------
 
-    void generateUntilDone();
+    void generateUntilDone(double endTime);
+
+    /** Appends the pattern's notes to scratch, or nothing if there are no patterns to pick from. */
+    void pickAndApplyPattern(double atBeat, double maxDuration);
 
-    /** Returns the index of the last note added. */
-    int pickAndApplyPattern(SongBeatmapData &output, int atIndex, double atBeat, double maxDuration);
+    void replayLocationsBefore(size_t index);
+    void spliceScratch(size_t fromIndex, size_t toIndex);
 
-    void possiblePatterns(Pattern_Vec &vec, double maxPatternDuration);
+    const PatternSampler & possiblePatterns(double maxPatternDuration) const;
 
 
 public:
     /** You create a generator to work on a particular map. */
     Generator(Song &_song, SongDifficulty &_difficulty, SongBeatmapData &_data);
 
+    LevelDifficulty getLevelDifficulty() const { return difficulty.difficulty; }
+
     // Methods for overriding preferences
 
     int getPatternSnapTo() const { return patternSnapTo; }
     double getMinimumInitialWhitespace() const { return minimumInitialWhitespace; }
     double getMinimumDelayBetweenPatterns() const { return minimumDelayBetweenPatterns; }
     double getMaximumDelayBetweenPatterns() const { return maximumDelayBetweenPatterns; }
+    uint64_t getSeed() const { return seed; }
 
     /**
      * New patterns will snap forward. patternSnapTo indicates the granularity.
@@ -213,6 +234,12 @@ public:
         return *this;
     }
 
+    /**
+     * We start with a random seed. Set a specific one and the same song, difficulty
+     * and seed will always produce the same map.
+     */
+    Generator & setSeed(uint64_t value);
+
     /**
      * Generate the entire song. This destroys the existing notes from the
      * SongBeatmapData and generates starting fresh.
@@ -221,7 +248,12 @@ public:
 
     /**
      * Generate for a range of the song. We retain the two referenced
-     * notes and throw away everything between them.
+     * notes and throw away everything between them. Pass -1 as the
+     * starting index to begin at the start of the song, or the note
+     * count as the ending index to run to the end.
+     *
+     * The new notes are built on the side and spliced in once, so this
+     * costs about the size of the range, not the size of the map.
      */
     void generateRange(int startingIndex, int endingIndex);
 };
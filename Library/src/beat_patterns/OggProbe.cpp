@@ -0,0 +1,129 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "OggProbe.h"
+
+namespace BeatPatterns {
+
+/** Every Ogg page starts with this, followed by a fixed 27-byte header. */
+static const char		OggCapture[4] = { 'O', 'g', 'g', 'S' };
+static const size_t		OggHeaderSize = 27;
+
+/** Pages are at most 64K or so, so the last page header is almost always in this much tail. */
+static const size_t		TailWindow = 65536 + 512;
+
+static uint32_t
+readLE32(const unsigned char *ptr) {
+    return static_cast<uint32_t>(ptr[0])
+        | (static_cast<uint32_t>(ptr[1]) << 8)
+        | (static_cast<uint32_t>(ptr[2]) << 16)
+        | (static_cast<uint32_t>(ptr[3]) << 24);
+}
+
+static uint64_t
+readLE64(const unsigned char *ptr) {
+    return static_cast<uint64_t>(readLE32(ptr)) | (static_cast<uint64_t>(readLE32(ptr + 4)) << 32);
+}
+
+/**
+ * Get the stream's serial number and sample rate from the first page.
+ */
+static bool
+readFirstPage(std::ifstream &input, uint32_t &serial, uint32_t &sampleRate) {
+    unsigned char header[OggHeaderSize];
+    if (!input.read(reinterpret_cast<char *>(header), OggHeaderSize) || memcmp(header, OggCapture, 4) != 0) {
+        return false;
+    }
+    serial = readLE32(header + 14);
+
+    // The segment table tells us how long the first packet is, but the
+    // identification header is fixed size, so we only need its start.
+    unsigned char segmentCount = header[26];
+    if (!input.seekg(segmentCount, std::ios::cur)) {
+        return false;
+    }
+
+    // 1 "vorbis" version(4) channels(1) rate(4)
+    unsigned char packet[16];
+    if (!input.read(reinterpret_cast<char *>(packet), sizeof(packet))) {
+        return false;
+    }
+    if (packet[0] != 1 || memcmp(packet + 1, "vorbis", 6) != 0) {
+        return false;
+    }
+
+    sampleRate = readLE32(packet + 12);
+    return sampleRate > 0;
+}
+
+/**
+ * Find the granule position on the last page of our stream. We look backwards
+ * through the tail of the file, widening the window if we have to.
+ */
+static bool
+readLastGranule(std::ifstream &input, uint32_t serial, uint64_t &granule) {
+    input.seekg(0, std::ios::end);
+    std::streamoff fileSize = input.tellg();
+    if (fileSize < static_cast<std::streamoff>(OggHeaderSize)) {
+        return false;
+    }
+
+    std::vector<unsigned char> buffer;
+    size_t window = TailWindow;
+
+    while (true) {
+        size_t length = static_cast<size_t>(fileSize) < window ? static_cast<size_t>(fileSize) : window;
+
+        buffer.resize(length);
+        input.clear();
+        input.seekg(fileSize - static_cast<std::streamoff>(length), std::ios::beg);
+        if (!input.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(length))) {
+            return false;
+        }
+
+        for (size_t pos = length - OggHeaderSize + 1; pos-- > 0; ) {
+            const unsigned char * page = buffer.data() + pos;
+            if (memcmp(page, OggCapture, 4) != 0 || page[4] != 0 || readLE32(page + 14) != serial) {
+                continue;
+            }
+
+            // -1 means no packet finishes on this page. Keep looking.
+            uint64_t thisGranule = readLE64(page + 6);
+            if (thisGranule != UINT64_MAX) {
+                granule = thisGranule;
+                return true;
+            }
+        }
+
+        if (length == static_cast<size_t>(fileSize)) {
+            return false;
+        }
+        window *= 4;
+    }
+}
+
+/**
+ * Get the length of an Ogg Vorbis file without decoding it.
+ */
+bool
+probeOggDuration(const std::string &fileName, double &seconds) {
+    std::ifstream input(fileName, std::ios::binary);
+    if (!input) {
+        return false;
+    }
+
+    uint32_t serial = 0;
+    uint32_t sampleRate = 0;
+    uint64_t granule = 0;
+
+    if (!readFirstPage(input, serial, sampleRate) || !readLastGranule(input, serial, granule)) {
+        return false;
+    }
+
+    seconds = static_cast<double>(granule) / sampleRate;
+    return true;
+}
+
+} // namespace BeatPatterns
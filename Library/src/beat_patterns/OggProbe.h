@@ -0,0 +1,18 @@
+#ifndef OGGPROBE_H
+#define OGGPROBE_H
+
+#include <string>
+
+namespace BeatPatterns {
+
+/**
+ * Get the length of an Ogg Vorbis file (.ogg or .egg) without decoding it. We read
+ * the sample rate from the identification header and the granule position (the
+ * sample count) from the last page. Returns false if this doesn't look like Ogg
+ * Vorbis, in which case you'll have to ask SFML.
+ */
+bool probeOggDuration(const std::string &fileName, double &seconds);
+
+} // namespace BeatPatterns
+
+#endif // OGGPROBE_H
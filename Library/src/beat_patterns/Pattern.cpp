@@ -1,7 +1,10 @@
 #include <cstdlib>
 #include <iostream>
+#include <algorithm>
+#include <mutex>
 #include <boost/filesystem.hpp>
 
+#include <showpage/Profiler.h>
 #include <showpage/StringMethods.h>
 
 #include "Pattern.h"
@@ -14,6 +17,51 @@ using JSON = nlohmann::json;
 
 namespace BeatPatterns {
 
+/** Guards Pattern_Vec::indexes, as generators running in parallel ask for them. */
+static std::mutex indexMutex;
+
+/** PatternIndex's direction groups. Cuts in the same group, other than NoDirection, are similar. */
+static const int NoDirection = 4;
+
+static int
+directionGroup(CutDirection direction) {
+    switch (direction) {
+    case CutDirection::Up:
+    case CutDirection::UpLeft:
+    case CutDirection::UpRight:
+        return 0;
+
+    case CutDirection::Down:
+    case CutDirection::DownLeft:
+    case CutDirection::DownRight:
+        return 1;
+
+    case CutDirection::Left:
+        return 2;
+
+    case CutDirection::Right:
+        return 3;
+
+    default:
+        return NoDirection;
+    }
+}
+
+/**
+ * The first note of this color in the pattern, or nullptr if it doesn't use that saber.
+ */
+static const Note *
+firstNoteFor(const Pattern *pattern, CubeType cubeType) {
+    for (const NoteSet & noteSet: pattern->noteSequence) {
+        for (const Note & note: noteSet) {
+            if (note.cubeType == cubeType) {
+                return &note;
+            }
+        }
+    }
+    return nullptr;
+}
+
 /**
  * Constructor.
  */
@@ -107,80 +155,111 @@ Pattern::isTransformation() const {
 }
 
 /**
- * We're a transformation.
+ * Get the pattern to actually use. For a transformation, that's the flattened
+ * copy we built when the patterns were loaded. Otherwise it's us.
  */
 Pattern *
 Pattern::getTransformation() {
+    return transformedPattern != nullptr ? transformedPattern : this;
+}
+
+const Pattern *
+Pattern::getTransformation() const {
+    return transformedPattern != nullptr ? transformedPattern : this;
+}
+
+/**
+ * If we're a transformation, build the flattened pattern we'll hand out from
+ * getTransformation(). Chains are resolved here, once, so the result is a plain
+ * pattern with its own starting locations and notes.
+ *
+ * The chain is the list of transformations we're already in the middle of
+ * compiling. If we find ourself on it, the patterns loop. Returns nullptr if we
+ * can't be compiled.
+ */
+Pattern *
+Pattern::compileTransformation(std::vector<const Pattern *> &chain) {
     // If we're not a transformation, then we return ourself.
     if (transformation.patternName.length() == 0) {
         return this;
     }
 
-    if (transformation.pattern == nullptr) {
-        cout << "Our transformation pattern is missing." << endl;
-        return this;
+    if (transformedPattern != nullptr) {
+        return transformedPattern;
     }
 
-    if (transformedPattern == nullptr) {
-        cout << "Produce transformation from " << transformation.patternName
-             << " to produce " << name
-             << (transformation.mirrorLeftRight ? " Mirror Left/Right" : "")
-             << endl;
+    if (transformation.pattern == nullptr) {
+        cout << "Pattern " << name << " transforms missing pattern " << transformation.patternName << endl;
+        return nullptr;
+    }
 
-        transformedPattern = new Pattern();
+    if (std::find(chain.begin(), chain.end(), this) != chain.end()) {
+        cout << "Pattern " << name << " is part of a transformation loop." << endl;
+        return nullptr;
+    }
 
-        Pattern * fromPattern = transformation.pattern->getTransformation();
+    chain.push_back(this);
+    Pattern * fromPattern = transformation.pattern->compileTransformation(chain);
+    chain.pop_back();
 
-        // Handle the starting locations
-        for (Location &loc: fromPattern->startingLocations) {
-            Location newLocation;
+    if (fromPattern == nullptr) {
+        return nullptr;
+    }
 
-            newLocation.preferred = loc.preferred;
-            newLocation.lineLayer = loc.lineLayer;
-            newLocation.lineIndex = transformation.mirrorLeftRight ? 3 - loc.lineIndex : loc.lineIndex;
+    Pattern * flat = new Pattern();
+    flat->name = name;
+    flat->difficulty = difficulty;
+    flat->stepBy.copyFrom(fromPattern->stepBy);
 
-            cout << "... Transform from " << loc << " to " << newLocation << endl;
+    // Handle the starting locations
+    for (const Location &loc: fromPattern->startingLocations) {
+        Location newLocation;
 
-            startingLocations.push_back(newLocation);
-        }
+        newLocation.preferred = loc.preferred;
+        newLocation.lineLayer = loc.lineLayer;
+        newLocation.lineIndex = transformation.mirrorLeftRight ? 3 - loc.lineIndex : loc.lineIndex;
 
-        // Handle the noteSequence
-        for (NoteSet &noteSet: fromPattern->noteSequence) {
-            NoteSet newNoteSet;
+        flat->startingLocations.push_back(newLocation);
+    }
 
-            for (Note &note: noteSet) {
-                Note newNote;
+    // Handle the noteSequence
+    for (const NoteSet &noteSet: fromPattern->noteSequence) {
+        NoteSet newNoteSet;
 
-                newNote.cubeType = transformation.swapColors ? swapCubeType(note.cubeType) : note.cubeType;
-                newNote.cutDirection = mirrorCutDirection(note.cutDirection, transformation.mirrorLeftRight, transformation.swapUpDown);
-                newNote.relativeX = transformation.mirrorLeftRight ? -note.relativeX : note.relativeX;
-                newNote.relativeY = note.relativeY;
+        for (const Note &note: noteSet) {
+            Note newNote;
 
-                newNoteSet.push_back(newNote);
-            }
+            newNote.cubeType = transformation.swapColors ? swapCubeType(note.cubeType) : note.cubeType;
+            newNote.cutDirection = mirrorCutDirection(note.cutDirection, transformation.mirrorLeftRight, transformation.swapUpDown);
+            newNote.relativeX = transformation.mirrorLeftRight ? -note.relativeX : note.relativeX;
+            newNote.relativeY = note.relativeY;
 
-            // Do after building as it's a copy.
-            transformedPattern->noteSequence.push_back(newNoteSet);
+            newNoteSet.push_back(newNote);
         }
+
+        // Do after building as it's a copy.
+        flat->noteSequence.push_back(newNoteSet);
     }
+
+    transformedPattern = flat;
     return transformedPattern;
 }
 
 /**
  * Pick one of our starting locations.
  */
-void Pattern::getStartingLocation(int &lineLayer, int &lineIndex) {
+void Pattern::getStartingLocation(Random &random, int &lineLayer, int &lineIndex) const {
     double sum = 0;
 
-    for (Location & loc: startingLocations) {
+    for (const Location & loc: startingLocations) {
         sum += loc.preferred ? 10 : 3;
     }
 
-    double multiplier = static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
+    double multiplier = random.fraction();
     double select = sum * multiplier;
 
     sum = 0;
-    for (Location & loc: startingLocations) {
+    for (const Location & loc: startingLocations) {
         sum += loc.preferred ? 10 : 3;
         if (sum >= select) {
             lineLayer = loc.lineLayer;
@@ -191,14 +270,101 @@ void Pattern::getStartingLocation(int &lineLayer, int &lineIndex) {
 }
 
 /**
- * How much of a beat do we step between notes?
+ * Pick one of our starting locations, steering clear of any that would put a saber's
+ * first note right where that saber already is. If they all would, we pick from all
+ * of them.
  */
-double Pattern::stepByFor(LevelDifficulty difficulty, int bpm) const {
-    if (transformation.patternName.length() == 0) {
-        if (transformation.pattern == nullptr) {
-            return 1.0;
+void Pattern::getStartingLocation(Random &random, int &lineLayer, int &lineIndex,
+                                  const SaberLocation &redLocation, const SaberLocation &blueLocation) const {
+    const Note * firstRed = firstNoteFor(this, CubeType::Red);
+    const Note * firstBlue = firstNoteFor(this, CubeType::Blue);
+
+    auto startsOnSaber = [&](const Location &loc) {
+        return (firstRed != nullptr && loc.lineLayer + firstRed->relativeY == redLocation.row && loc.lineIndex + firstRed->relativeX == redLocation.col)
+            || (firstBlue != nullptr && loc.lineLayer + firstBlue->relativeY == blueLocation.row && loc.lineIndex + firstBlue->relativeX == blueLocation.col);
+    };
+
+    double sum = 0;
+
+    for (const Location & loc: startingLocations) {
+        if (!startsOnSaber(loc)) {
+            sum += loc.preferred ? 10 : 3;
         }
-        return transformation.pattern->stepByFor(difficulty, bpm);
+    }
+
+    if (sum == 0) {
+        getStartingLocation(random, lineLayer, lineIndex);
+        return;
+    }
+
+    double multiplier = random.fraction();
+    double select = sum * multiplier;
+
+    sum = 0;
+    for (const Location & loc: startingLocations) {
+        if (startsOnSaber(loc)) {
+            continue;
+        }
+        sum += loc.preferred ? 10 : 3;
+        if (sum >= select) {
+            lineLayer = loc.lineLayer;
+            lineIndex = loc.lineIndex;
+            return;
+        }
+    }
+}
+
+/**
+ * Does this pattern flow from where this saber is? Below Hard, its first note for
+ * the saber shouldn't cut the same general way the saber just did. And at any level,
+ * it shouldn't be certain to start right where the saber already is. A pattern that
+ * doesn't use the saber is always fine.
+ */
+bool
+Pattern::compatibleWithSaber(CubeType cubeType, const SaberLocation &location, LevelDifficulty forDifficulty) const {
+    const Pattern * flat = getTransformation();
+    const Note * first = firstNoteFor(flat, cubeType);
+
+    if (first == nullptr) {
+        return true;
+    }
+
+    int group = directionGroup(first->cutDirection);
+    bool belowHard = forDifficulty == LevelDifficulty::Easy || forDifficulty == LevelDifficulty::Normal;
+    if (belowHard && group != NoDirection && group == directionGroup(location.lastCutDirection)) {
+        return false;
+    }
+
+    // With no starting locations, the generator starts at the bottom row, third column.
+    if (flat->startingLocations.empty()) {
+        return first->relativeY != location.row || 2 + first->relativeX != location.col;
+    }
+
+    for (const Location & loc: flat->startingLocations) {
+        if (loc.lineLayer + first->relativeY != location.row || loc.lineIndex + first->relativeX != location.col) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Is this a pattern we could move on to from where both sabers are?
+ */
+bool
+Pattern::compatibleWithSaberLocations(const SaberLocation &redLocation, const SaberLocation &blueLocation, LevelDifficulty forDifficulty) const {
+    return compatibleWithSaber(CubeType::Red, redLocation, forDifficulty)
+        && compatibleWithSaber(CubeType::Blue, blueLocation, forDifficulty);
+}
+
+/**
+ * How much of a beat do we step between notes? Transformations step the same as
+ * the pattern they're built from, which compileTransformation() copied into the
+ * flattened pattern. One that didn't compile just uses its own (normally empty) step-by.
+ */
+double Pattern::stepByFor(LevelDifficulty difficulty, int bpm) const {
+    if (transformedPattern != nullptr) {
+        return transformedPattern->stepByFor(difficulty, bpm);
     }
 
     return stepBy.stepByFor(difficulty, bpm);
@@ -258,6 +424,7 @@ Pattern_Vec::load(const std::string &fileOrDirName) {
 
 /**
  * This is where we map from name to the pattern and then resolve any links.
+ * Transformations are compiled here too, so generating never has to.
  */
 void
 Pattern_Vec::mapInto(std::map<string, Pattern *> &map) {
@@ -275,36 +442,329 @@ Pattern_Vec::mapInto(std::map<string, Pattern *> &map) {
             }
         }
     }
+
+    // And flatten the transformations.
+    std::vector<const Pattern *> chain;
+    for (Pattern *pattern: *this) {
+        pattern->compileTransformation(chain);
+    }
 }
 
 /**
- * This method randomly selects one of the patterns.
+ * Call this once the patterns are loaded, and again if you add or remove patterns
+ * or change their weights. We drop every PatternIndex, and each is built again
+ * the next time it's asked for. Weights only change when the pattern files are
+ * loaded again, so Preferences::loadPatterns() is the one caller.
  */
-Pattern *
-Pattern_Vec::selectPattern(LevelDifficulty forDifficulty) {
+void
+Pattern_Vec::patternsChanged() {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    indexes.clear();
+}
+
+/**
+ * Get the PatternIndex for this level difficulty and BPM, building it the first time
+ * anyone asks. It never changes once built, so generators running in parallel can
+ * share it. patternsChanged() drops it rather than touching it, so anyone still
+ * holding the old one can finish with it.
+ */
+std::shared_ptr<const PatternIndex>
+Pattern_Vec::getIndex(LevelDifficulty forDifficulty, int bpm) {
+    if (forDifficulty == LevelDifficulty::All) {
+        forDifficulty = LevelDifficulty::Easy;
+    }
+
+    std::lock_guard<std::mutex> lock(indexMutex);
+    std::shared_ptr<const PatternIndex> & index = indexes[std::make_pair(static_cast<int>(forDifficulty), bpm)];
+
+    if (index == nullptr) {
+        Profiler::Scope scope("patternIndex", levelDifficultyToString(forDifficulty));
+        std::shared_ptr<PatternIndex> built = std::make_shared<PatternIndex>();
+
+        built->build(*this, forDifficulty, bpm);
+        index = built;
+    }
+    return index;
+}
+
+//======================================================================
+// PatternIndex
+//======================================================================
+
+/**
+ * Sort out the candidates for every combination of saber buckets and room left.
+ * We work out which patterns pass for each saber bucket on its own, which is all
+ * compatibleWithSaberLocations() needs. Lots of buckets allow the same patterns,
+ * so we number the different answers and only combine those.
+ */
+void
+PatternIndex::build(const std::vector<Pattern *> &candidates, LevelDifficulty forDifficulty, int bpm) {
+    typedef std::vector<bool> Mask;
+
+    lengths.clear();
+    samplers.clear();
+    table.clear();
+
+    // The patterns we'd ever use at this difficulty, and how many beats each runs.
+    std::vector<Pattern *> eligible;
+    std::vector<double> patternLengths;
+
+    for (Pattern * pattern: candidates) {
+        const Pattern * flat = pattern->getTransformation();
+        if (pattern->getWeight(forDifficulty) <= 0 || flat->noteSequence.empty()) {
+            continue;
+        }
+
+        double stepBy = pattern->stepByFor(forDifficulty, bpm);
+        if (stepBy <= 0.0) {
+            stepBy = 1.0;
+        }
+
+        eligible.push_back(pattern);
+        patternLengths.push_back((flat->noteSequence.size() - 1) * stepBy);
+    }
+
+    lengths = patternLengths;
+    std::sort(lengths.begin(), lengths.end());
+    lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+
+    size_t count = eligible.size();
+
+    // Which patterns each saber bucket allows. A bucket stands for any saber in that
+    // cell whose last cut was in that group, so one of each decides it.
+    static const CutDirection groupDirections[DirectionGroups] = {
+        CutDirection::Up, CutDirection::Down, CutDirection::Left, CutDirection::Right, CutDirection::Center
+    };
+
+    std::vector<Mask> redMasks;
+    std::vector<Mask> blueMasks;
+    std::map<Mask, uint32_t> redSeen;
+    std::map<Mask, uint32_t> blueSeen;
+    Mask redMask(count);
+    Mask blueMask(count);
+
+    for (int bucket = 0; bucket < SaberBuckets; ++bucket) {
+        SaberLocation location;
+        int cell = bucket / DirectionGroups;
+
+        location.row = cell / 4;
+        location.col = cell % 4;
+        location.lastCutDirection = groupDirections[bucket % DirectionGroups];
+
+        for (size_t index = 0; index < count; ++index) {
+            redMask[index] = eligible[index]->compatibleWithSaber(CubeType::Red, location, forDifficulty);
+            blueMask[index] = eligible[index]->compatibleWithSaber(CubeType::Blue, location, forDifficulty);
+        }
+
+        auto red = redSeen.insert(std::make_pair(redMask, static_cast<uint32_t>(redMasks.size())));
+        if (red.second) {
+            redMasks.push_back(redMask);
+        }
+        redClasses[bucket] = red.first->second;
+
+        auto blue = blueSeen.insert(std::make_pair(blueMask, static_cast<uint32_t>(blueMasks.size())));
+        if (blue.second) {
+            blueMasks.push_back(blueMask);
+        }
+        blueClasses[bucket] = blue.first->second;
+    }
+
+    blueClassCount = blueMasks.size();
+
+    // Which patterns fit each length bucket. In bucket 0 nothing fits, so we take
+    // anything, the same as if we didn't know.
+    size_t lengthBuckets = lengths.size() + 1;
+    std::vector<Mask> lengthMasks(lengthBuckets, Mask(count, true));
+
+    for (size_t lengthBucket = 1; lengthBucket < lengthBuckets; ++lengthBucket) {
+        for (size_t index = 0; index < count; ++index) {
+            lengthMasks[lengthBucket][index] = patternLengths[index] <= lengths[lengthBucket - 1];
+        }
+    }
+
+    // Now every combination, sharing samplers between combinations with the same patterns.
+    std::map<Mask, uint32_t> seen;
+    std::vector<Pattern *> chosen;
+    Mask mask(count);
+
+    table.resize(redMasks.size() * blueMasks.size() * lengthBuckets);
+
+    for (uint32_t redClass = 0; redClass < redMasks.size(); ++redClass) {
+        for (uint32_t blueClass = 0; blueClass < blueMasks.size(); ++blueClass) {
+            for (size_t lengthBucket = 0; lengthBucket < lengthBuckets; ++lengthBucket) {
+                const Mask & fits = lengthMasks[lengthBucket];
+                bool any = false;
+
+                for (size_t index = 0; index < count; ++index) {
+                    mask[index] = redMasks[redClass][index] && blueMasks[blueClass][index] && fits[index];
+                    any = any || mask[index];
+                }
+
+                // Nothing flows from here. Better a pattern that fits than none.
+                if (!any) {
+                    mask = fits;
+                }
+
+                auto pos = seen.find(mask);
+                if (pos == seen.end()) {
+                    chosen.clear();
+                    for (size_t index = 0; index < count; ++index) {
+                        if (mask[index]) {
+                            chosen.push_back(eligible[index]);
+                        }
+                    }
+
+                    samplers.emplace_back();
+                    samplers.back().build(chosen, forDifficulty);
+                    pos = seen.insert(std::make_pair(mask, static_cast<uint32_t>(samplers.size() - 1))).first;
+                }
+
+                table[tableIndex(redClass, blueClass, lengthBucket)] = pos->second;
+            }
+        }
+    }
+}
+
+/**
+ * Where this combination lives in the table.
+ */
+size_t
+PatternIndex::tableIndex(uint32_t redClass, uint32_t blueClass, size_t lengthBucket) const {
+    return (redClass * blueClassCount + blueClass) * (lengths.size() + 1) + lengthBucket;
+}
+
+/**
+ * The candidates for sabers here, when a pattern can run at most maxBeats.
+ */
+const PatternSampler &
+PatternIndex::lookup(const SaberLocation &redLocation, const SaberLocation &blueLocation, double maxBeats) const {
+    size_t lengthBucket = std::upper_bound(lengths.begin(), lengths.end(), maxBeats) - lengths.begin();
+    uint32_t redClass = redClasses[saberBucket(redLocation)];
+    uint32_t blueClass = blueClasses[saberBucket(blueLocation)];
+
+    return samplers[table[tableIndex(redClass, blueClass, lengthBucket)]];
+}
+
+/**
+ * Which bucket a saber falls in. Anywhere off the standard grid counts as the
+ * nearest cell on it.
+ */
+int
+PatternIndex::saberBucket(const SaberLocation &location) {
+    int row = std::min(std::max(location.row, 0), 2);
+    int col = std::min(std::max(location.col, 0), 3);
+
+    return (row * 4 + col) * DirectionGroups + directionGroup(location.lastCutDirection);
+}
+
+//======================================================================
+// PatternSampler
+//======================================================================
+
+/**
+ * Build our alias table (Vose's method). Each slot gets a probability of
+ * keeping its own pattern; the rest of the slot's share goes to its alias.
+ */
+void
+PatternSampler::build(const std::vector<Pattern *> &candidates, LevelDifficulty forDifficulty) {
+    clear();
+
+    std::vector<double> weights;
     double sum = 0.0;
 
-    for (auto iter = this->cbegin(); iter != this->cend(); iter++) {
-        Pattern * const pattern = *iter;
-        sum += pattern->getWeight(forDifficulty);
+    for (Pattern * pattern: candidates) {
+        int weight = pattern->getWeight(forDifficulty);
+
+        // A transformation we couldn't compile has no notes to place.
+        if (weight > 0 && !pattern->getTransformation()->noteSequence.empty()) {
+            patterns.push_back(pattern);
+            weights.push_back(weight);
+            sum += weight;
+        }
     }
 
-    double multiplier = static_cast<double>(rand()) / static_cast<double>(RAND_MAX);
-    double select = sum * multiplier;
+    size_t count = patterns.size();
+    if (count == 0) {
+        return;
+    }
+
+    probability.resize(count);
+    alias.resize(count);
+
+    // Scale so the average slot is exactly 1.0, then split into under- and over-full.
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+
+    for (size_t index = 0; index < count; ++index) {
+        weights[index] = weights[index] * count / sum;
+        if (weights[index] < 1.0) {
+            small.push_back(static_cast<uint32_t>(index));
+        }
+        else {
+            large.push_back(static_cast<uint32_t>(index));
+        }
+    }
 
-    Pattern * retVal = nullptr;
-    sum = 0.0;
-    for (auto iter = this->cbegin(); iter != this->cend(); iter++) {
-        retVal = *iter;
-        int thisWeight = retVal->getWeight(forDifficulty);
+    // Top up each small slot from a large one.
+    while (!small.empty() && !large.empty()) {
+        uint32_t less = small.back();
+        uint32_t more = large.back();
+        small.pop_back();
+        large.pop_back();
 
-        sum += thisWeight;
-        if (sum > select) {
-            break;
+        probability[less] = weights[less];
+        alias[less] = more;
+
+        weights[more] = (weights[more] + weights[less]) - 1.0;
+        if (weights[more] < 1.0) {
+            small.push_back(more);
+        }
+        else {
+            large.push_back(more);
         }
     }
 
-    return retVal;
+    // Whatever's left is full, give or take rounding.
+    for (uint32_t index: large) {
+        probability[index] = 1.0;
+        alias[index] = index;
+    }
+    for (uint32_t index: small) {
+        probability[index] = 1.0;
+        alias[index] = index;
+    }
+}
+
+/**
+ * Forget everything.
+ */
+void
+PatternSampler::clear() {
+    patterns.clear();
+    probability.clear();
+    alias.clear();
+}
+
+/**
+ * Draw one pattern. Returns nullptr if there aren't any.
+ */
+Pattern *
+PatternSampler::sample(Random &random) const {
+    size_t count = patterns.size();
+    if (count == 0) {
+        return nullptr;
+    }
+
+    size_t index = static_cast<size_t>(random.fraction() * count);
+    if (index >= count) {
+        index = count - 1;
+    }
+
+    if (random.fraction() >= probability[index]) {
+        index = alias[index];
+    }
+
+    return patterns[index];
 }
 
 //======================================================================
@@ -415,13 +875,32 @@ std::ostream & operator<<(std::ostream &os, const Location &loc) {
 // Step-By Data, which controls the speed of a pattern.
 //======================================================================
 
+/**
+ * Make us a copy of this one. We own our entries, so we copy those too.
+ */
+void
+StepBy::copyFrom(const StepBy &from) {
+    auto copyVec = [](BPMStepBy_Vec &to, const BPMStepBy_Vec &fromVec) {
+        to.eraseAll();
+        for (const BPMStepBy * stepBy: fromVec) {
+            to.push_back(new BPMStepBy(*stepBy));
+        }
+    };
+
+    copyVec(easy, from.easy);
+    copyVec(normal, from.normal);
+    copyVec(hard, from.hard);
+    copyVec(expert, from.expert);
+    copyVec(expertPlus, from.expertPlus);
+}
+
 /**
  * What step-by (portion of a beat) should we use for this level difficulty and BPM.
  */
 double
-StepBy::stepByFor(LevelDifficulty difficulty, int bpm) {
+StepBy::stepByFor(LevelDifficulty difficulty, int bpm) const {
     double rv = 1.0;
-    JSON_Serializable_PointerVector<BPMStepBy> * use = nullptr;
+    const JSON_Serializable_PointerVector<BPMStepBy> * use = nullptr;
 
     // We don't necessarily have data for each level difficulty, so grab
     // the harest one that makes sense.
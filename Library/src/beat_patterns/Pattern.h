@@ -4,12 +4,14 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <memory>
 
 #include <showpage/JSON_Serializable.h>
 #include <showpage/PointerVector.h>
 
 #include "SaberLocation.h"
 #include "Common.h"
+#include "Random.h"
 
 //
 // Definitions of the various slice patterns we understand. Patterns are laoded
@@ -168,6 +170,8 @@ public:
     };
 
 private:
+    friend class PatternCache;
+
     BPMStepBy_Vec easy;
     BPMStepBy_Vec normal;
     BPMStepBy_Vec hard;
@@ -176,6 +180,7 @@ private:
 
 public:
     double stepByFor(LevelDifficulty difficulty, int bpm) const;
+    void copyFrom(const StepBy &from);
 
     void fromJSON(const nlohmann::json & json);
     void toJSON(nlohmann::json & json) const;
@@ -211,14 +216,92 @@ public:
     int getWeight(LevelDifficulty forDifficulty) const;
     bool isTransformation() const;
     Pattern * getTransformation();
+    const Pattern * getTransformation() const;
+    Pattern * compileTransformation(std::vector<const Pattern *> &chain);
 
-    void getStartingLocation(int &lineLayer, int &lineIndex);
+    void getStartingLocation(Random &random, int &lineLayer, int &lineIndex) const;
+    void getStartingLocation(Random &random, int &lineLayer, int &lineIndex,
+                             const SaberLocation &redLocation, const SaberLocation &blueLocation) const;
     double stepByFor(LevelDifficulty difficulty, int bpm) const;
 
-    bool compatibleWithSaberLocations(SaberLocation &redLocation, SaberLocation &blueLocation);
+    bool compatibleWithSaber(CubeType cubeType, const SaberLocation &location, LevelDifficulty forDifficulty) const;
+    bool compatibleWithSaberLocations(const SaberLocation &redLocation, const SaberLocation &blueLocation, LevelDifficulty forDifficulty) const;
+};
+
+/**
+ * This draws weighted patterns in constant time using Vose's alias method. We
+ * build it once from a list of candidates and their weights for one difficulty,
+ * after which each draw is two random numbers and a table lookup, no matter how
+ * many patterns there are. Patterns with a weight of zero, or with no notes, are left out.
+ */
+class PatternSampler {
+private:
+    std::vector<Pattern *>	patterns;
+    std::vector<double>		probability;
+    std::vector<uint32_t>	alias;
+
+public:
+    void build(const std::vector<Pattern *> &candidates, LevelDifficulty forDifficulty);
+    void clear();
+
+    Pattern * sample(Random &random) const;
+
+    size_t size() const { return patterns.size(); }
+    bool empty() const { return patterns.empty(); }
+};
+
+/**
+ * The candidates for one difficulty at one BPM, sorted out ahead of time by where
+ * the sabers are and how much room is left, so the generator can follow the flow
+ * rules without checking every pattern each time it picks one.
+ *
+ * Each saber falls into a bucket by its grid cell and the general direction of its
+ * last cut, and buckets that allow the same patterns share a class. Room left falls
+ * into a bucket by how many of the distinct pattern lengths fit. Every combination
+ * of the two classes and the length bucket maps to a PatternSampler of the patterns
+ * that pass compatibleWithSaberLocations() and fit. Combinations with the same
+ * candidates share a sampler.
+ *
+ * If nothing passes the saber rules we fall back to everything that fits, and if
+ * nothing fits, to every pattern for the difficulty.
+ */
+class PatternIndex {
+public:
+    /** Up, down, left, right, and none (dots, or not moving yet). */
+    static const int DirectionGroups = 5;
+    static const int SaberBuckets = 12 * DirectionGroups;
+
+private:
+    /** The distinct pattern lengths, in beats, shortest first. */
+    std::vector<double>			lengths;
+
+    std::vector<PatternSampler>	samplers;
+
+    /** Each saber bucket's class. */
+    uint32_t					redClasses[SaberBuckets];
+    uint32_t					blueClasses[SaberBuckets];
+    size_t						blueClassCount = 0;
+
+    /** Indexed by tableIndex(), giving the position in samplers. */
+    std::vector<uint32_t>		table;
+
+    size_t tableIndex(uint32_t redClass, uint32_t blueClass, size_t lengthBucket) const;
+
+public:
+    void build(const std::vector<Pattern *> &candidates, LevelDifficulty forDifficulty, int bpm);
+
+    const PatternSampler & lookup(const SaberLocation &redLocation, const SaberLocation &blueLocation, double maxBeats) const;
+
+    size_t samplerCount() const { return samplers.size(); }
+
+    static int saberBucket(const SaberLocation &location);
 };
 
 class Pattern_Vec: public JSON_Serializable_PointerVector<Pattern> {
+private:
+    /** Pattern lengths depend on the BPM, so the indexes are by difficulty and BPM, built as asked for. */
+    std::map<std::pair<int, int>, std::shared_ptr<const PatternIndex>> indexes;
+
 public:
     Pattern_Vec() {}
     Pattern_Vec(bool v): JSON_Serializable_PointerVector<Pattern>(v) { }
@@ -227,7 +310,8 @@ public:
     void load(const std::string &fileOrDirName);
     void mapInto(std::map<std::string, Pattern *> & map);
 
-    Pattern * selectPattern(LevelDifficulty forDifficulty);
+    void patternsChanged();
+    std::shared_ptr<const PatternIndex> getIndex(LevelDifficulty forDifficulty, int bpm);
 };
 
 
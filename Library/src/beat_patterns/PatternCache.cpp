@@ -0,0 +1,351 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <showpage/BinaryCodec.h>
+#include <showpage/FileUtilities.h>
+#include <showpage/MappedFile.h>
+
+#include "PatternCache.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace BeatPatterns {
+
+/** Bump the version any time the layout below changes. */
+static const char		CacheMagic[8] = { 'B', 'P', 'A', 'T', 'C', 'A', 'C', 'H' };
+static const uint32_t	CacheVersion = 1;
+static const uint32_t	CacheByteOrder = 0x01020304;
+static const uint32_t	CacheEndMarker = 0x454E4421;
+
+//======================================================================
+// Pattern encoding.
+//======================================================================
+
+static void
+writeStepBys(BinaryWriter &writer, const StepBy::BPMStepBy_Vec &vec) {
+    writer.put<uint32_t>(static_cast<uint32_t>(vec.size()));
+    for (const StepBy::BPMStepBy *stepBy: vec) {
+        writer.put<int32_t>(stepBy->maxBPM);
+        writer.put<double>(stepBy->stepBy);
+    }
+}
+
+static void
+readStepBys(BinaryReader &reader, StepBy::BPMStepBy_Vec &vec) {
+    uint32_t count = reader.get<uint32_t>();
+    if (!reader.fits(count, sizeof(int32_t) + sizeof(double))) {
+        return;
+    }
+    for (uint32_t index = 0; index < count; ++index) {
+        StepBy::BPMStepBy * stepBy = new StepBy::BPMStepBy();
+        stepBy->maxBPM = reader.get<int32_t>();
+        stepBy->stepBy = reader.get<double>();
+        vec.push_back(stepBy);
+    }
+}
+
+void
+PatternCache::writePattern(BinaryWriter &writer, const Pattern &pattern) {
+    writer.putString(pattern.name);
+    writer.put<int32_t>(static_cast<int32_t>(pattern.difficulty));
+
+    writer.put<int32_t>(pattern.useWeights.easy);
+    writer.put<int32_t>(pattern.useWeights.normal);
+    writer.put<int32_t>(pattern.useWeights.hard);
+    writer.put<int32_t>(pattern.useWeights.expert);
+    writer.put<int32_t>(pattern.useWeights.expertPlus);
+
+    writeStepBys(writer, pattern.stepBy.easy);
+    writeStepBys(writer, pattern.stepBy.normal);
+    writeStepBys(writer, pattern.stepBy.hard);
+    writeStepBys(writer, pattern.stepBy.expert);
+    writeStepBys(writer, pattern.stepBy.expertPlus);
+
+    writer.put<uint32_t>(static_cast<uint32_t>(pattern.startingLocations.size()));
+    for (const Location &loc: pattern.startingLocations) {
+        writer.put<int32_t>(loc.lineIndex);
+        writer.put<int32_t>(loc.lineLayer);
+        writer.put<uint8_t>(loc.preferred ? 1 : 0);
+    }
+
+    writer.put<uint32_t>(static_cast<uint32_t>(pattern.noteSequence.size()));
+    for (const NoteSet &noteSet: pattern.noteSequence) {
+        writer.put<uint32_t>(static_cast<uint32_t>(noteSet.size()));
+        for (const Note &note: noteSet) {
+            writer.put<int32_t>(static_cast<int32_t>(note.cubeType));
+            writer.put<int32_t>(static_cast<int32_t>(note.cutDirection));
+            writer.put<int32_t>(note.relativeX);
+            writer.put<int32_t>(note.relativeY);
+        }
+    }
+
+    writer.putString(pattern.transformation.patternName);
+    writer.put<uint8_t>(pattern.transformation.swapColors ? 1 : 0);
+    writer.put<uint8_t>(pattern.transformation.mirrorLeftRight ? 1 : 0);
+    writer.put<uint8_t>(pattern.transformation.swapUpDown ? 1 : 0);
+    writer.put<uint8_t>(pattern.transformation.duplicateCubes ? 1 : 0);
+}
+
+void
+PatternCache::readPattern(BinaryReader &reader, Pattern &pattern) {
+    pattern.name = reader.getString();
+    pattern.difficulty = static_cast<PatternDifficulty>(reader.get<int32_t>());
+
+    pattern.useWeights.easy = reader.get<int32_t>();
+    pattern.useWeights.normal = reader.get<int32_t>();
+    pattern.useWeights.hard = reader.get<int32_t>();
+    pattern.useWeights.expert = reader.get<int32_t>();
+    pattern.useWeights.expertPlus = reader.get<int32_t>();
+
+    readStepBys(reader, pattern.stepBy.easy);
+    readStepBys(reader, pattern.stepBy.normal);
+    readStepBys(reader, pattern.stepBy.hard);
+    readStepBys(reader, pattern.stepBy.expert);
+    readStepBys(reader, pattern.stepBy.expertPlus);
+
+    uint32_t locationCount = reader.get<uint32_t>();
+    if (!reader.fits(locationCount, 2 * sizeof(int32_t) + 1)) {
+        return;
+    }
+    for (uint32_t index = 0; index < locationCount; ++index) {
+        Location loc;
+        loc.lineIndex = reader.get<int32_t>();
+        loc.lineLayer = reader.get<int32_t>();
+        loc.preferred = reader.get<uint8_t>() != 0;
+        pattern.startingLocations.push_back(loc);
+    }
+
+    uint32_t setCount = reader.get<uint32_t>();
+    if (!reader.fits(setCount, sizeof(uint32_t))) {
+        return;
+    }
+    for (uint32_t setIndex = 0; setIndex < setCount; ++setIndex) {
+        NoteSet noteSet;
+        uint32_t noteCount = reader.get<uint32_t>();
+        if (!reader.fits(noteCount, 4 * sizeof(int32_t))) {
+            return;
+        }
+        for (uint32_t index = 0; index < noteCount; ++index) {
+            Note note;
+            note.cubeType = static_cast<CubeType>(reader.get<int32_t>());
+            note.cutDirection = static_cast<CutDirection>(reader.get<int32_t>());
+            note.relativeX = reader.get<int32_t>();
+            note.relativeY = reader.get<int32_t>();
+            noteSet.push_back(note);
+        }
+        pattern.noteSequence.push_back(noteSet);
+    }
+
+    pattern.transformation.patternName = reader.getString();
+    pattern.transformation.swapColors = reader.get<uint8_t>() != 0;
+    pattern.transformation.mirrorLeftRight = reader.get<uint8_t>() != 0;
+    pattern.transformation.swapUpDown = reader.get<uint8_t>() != 0;
+    pattern.transformation.duplicateCubes = reader.get<uint8_t>() != 0;
+}
+
+//======================================================================
+// PatternCache
+//======================================================================
+
+/**
+ * Constructor. The cache file holds patterns from patternsDir.
+ */
+PatternCache::PatternCache(const std::string &_cacheFileName, const std::string &_patternsDir)
+    : cacheFileName(_cacheFileName), patternsDir(_patternsDir)
+{
+}
+
+/**
+ * Stat every file Pattern_Vec::load() would read: patternsDir itself if it's a
+ * file, otherwise everything under it that doesn't begin with a dot. We don't
+ * hash here; that's only needed when the stat doesn't match.
+ */
+void
+PatternCache::listFiles(std::vector<FileStamp> &stamps) const {
+    boost::filesystem::path root(patternsDir);
+    std::vector<boost::filesystem::path> toVisit { root };
+
+    while (!toVisit.empty()) {
+        boost::filesystem::path path = toVisit.back();
+        toVisit.pop_back();
+
+        if (boost::filesystem::is_regular(path)) {
+            FileStamp stamp;
+            if (FileUtilities::statFile(path.string(), stamp.size, stamp.modified)) {
+                stamp.relativePath = path == root ? path.filename().string() : path.string().substr(root.string().size());
+                stamps.push_back(stamp);
+            }
+        }
+        else if (boost::filesystem::is_directory(path)) {
+            boost::filesystem::directory_iterator end_iter;
+            for ( boost::filesystem::directory_iterator dir_itr( path ); dir_itr != end_iter; ++dir_itr ) {
+                boost::filesystem::path childPath = dir_itr->path();
+                if (childPath.filename().string().at(0) != '.') {
+                    toVisit.push_back(childPath);
+                }
+            }
+        }
+    }
+
+    std::sort(stamps.begin(), stamps.end(),
+        [](const FileStamp &a, const FileStamp &b) { return a.relativePath < b.relativePath; });
+}
+
+/**
+ * 64-bit FNV-1a of the file's contents.
+ */
+bool
+PatternCache::hashFile(FileStamp &stamp) const {
+    boost::filesystem::path root(patternsDir);
+    string fileName = boost::filesystem::is_regular(root) ? patternsDir : patternsDir + stamp.relativePath;
+
+    std::ifstream input(fileName, std::ios::binary);
+    if (!input) {
+        return false;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char buffer[16384];
+    while (input) {
+        input.read(buffer, sizeof(buffer));
+        std::streamsize got = input.gcount();
+        for (std::streamsize index = 0; index < got; ++index) {
+            hash ^= static_cast<unsigned char>(buffer[index]);
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    stamp.hash = hash;
+    return true;
+}
+
+/**
+ * Try to load the patterns from the cache. We return false, and leave into as we
+ * found it, if there's no cache, it's damaged, or any pattern file has changed.
+ */
+bool
+PatternCache::load(Pattern_Vec &into) {
+    MappedFile file;
+    if (!file.open(cacheFileName) || file.size() == 0) {
+        return false;
+    }
+
+    BinaryReader reader(file.data(), file.size());
+    bool refresh = false;
+    bool valid = false;
+    size_t startingSize = into.size();
+
+    char magic[sizeof(CacheMagic)];
+    for (char &ch: magic) {
+        ch = reader.get<char>();
+    }
+
+    if (memcmp(magic, CacheMagic, sizeof(CacheMagic)) == 0
+        && reader.get<uint32_t>() == CacheVersion
+        && reader.get<uint32_t>() == CacheByteOrder
+        && reader.getString() == patternsDir)
+    {
+        std::vector<FileStamp> current;
+        listFiles(current);
+
+        uint32_t fileCount = reader.get<uint32_t>();
+        valid = reader.ok && fileCount == current.size();
+
+        for (uint32_t index = 0; valid && index < fileCount; ++index) {
+            FileStamp &stamp = current[index];
+            string relativePath = reader.getString();
+            uint64_t size = reader.get<uint64_t>();
+            int64_t modified = reader.get<int64_t>();
+            uint64_t hash = reader.get<uint64_t>();
+
+            if (!reader.ok || relativePath != stamp.relativePath || size != stamp.size) {
+                valid = false;
+            }
+
+            // Touched but maybe not changed. Only the contents can tell us.
+            else if (modified != stamp.modified) {
+                valid = hashFile(stamp) && stamp.hash == hash;
+                refresh = true;
+            }
+        }
+
+        uint32_t patternCount = valid ? reader.get<uint32_t>() : 0;
+        for (uint32_t index = 0; valid && reader.ok && index < patternCount; ++index) {
+            Pattern * pattern = new Pattern();
+            readPattern(reader, *pattern);
+            into.push_back(pattern);
+        }
+
+        valid = valid && reader.get<uint32_t>() == CacheEndMarker && reader.ok && reader.atEnd();
+    }
+
+    file.close();
+
+    if (!valid) {
+        while (into.size() > startingSize) {
+            delete into.back();
+            into.pop_back();
+        }
+        return false;
+    }
+
+    if (refresh) {
+        save(into);
+    }
+
+    return true;
+}
+
+/**
+ * Write the cache for these patterns, which should be what we just loaded from
+ * patternsDir. We write a uniquely named temporary file and rename it into place
+ * so a reader never sees half a cache.
+ */
+void
+PatternCache::save(const Pattern_Vec &from) const {
+    std::vector<FileStamp> stamps;
+    listFiles(stamps);
+
+    BinaryWriter writer;
+
+    writer.bytes.append(CacheMagic, sizeof(CacheMagic));
+    writer.put<uint32_t>(CacheVersion);
+    writer.put<uint32_t>(CacheByteOrder);
+    writer.putString(patternsDir);
+
+    writer.put<uint32_t>(static_cast<uint32_t>(stamps.size()));
+    for (FileStamp &stamp: stamps) {
+        if (!hashFile(stamp)) {
+            return;
+        }
+        writer.putString(stamp.relativePath);
+        writer.put<uint64_t>(stamp.size);
+        writer.put<int64_t>(stamp.modified);
+        writer.put<uint64_t>(stamp.hash);
+    }
+
+    writer.put<uint32_t>(static_cast<uint32_t>(from.size()));
+    for (const Pattern *pattern: from) {
+        writePattern(writer, *pattern);
+    }
+    writer.put<uint32_t>(CacheEndMarker);
+
+    // Two copies of the program can save at once, so each writes its own temporary.
+    string tempName = cacheFileName + "." + boost::filesystem::unique_path("%%%%-%%%%-%%%%").string() + ".tmp";
+    std::ofstream output(tempName, std::ios::binary | std::ios::trunc);
+    output.write(writer.bytes.data(), static_cast<std::streamsize>(writer.bytes.size()));
+    output.close();
+
+    if (!output || std::rename(tempName.c_str(), cacheFileName.c_str()) != 0) {
+        cout << "Unable to write pattern cache " << cacheFileName << endl;
+        std::remove(tempName.c_str());
+    }
+}
+
+} // namespace BeatPatterns
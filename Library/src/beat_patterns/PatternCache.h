@@ -0,0 +1,55 @@
+#ifndef PATTERNCACHE_H
+#define PATTERNCACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Pattern.h"
+
+class BinaryWriter;
+class BinaryReader;
+
+namespace BeatPatterns {
+
+/**
+ * Parsing the Patterns directory is most of the CLI's startup time, so we keep a
+ * binary copy of the pattern library in ~/.BeatPatternsCache. The cache records
+ * each pattern file's name, size, modification time and a hash of its contents.
+ * If the files haven't changed, we read the cache with MappedFile and decode the
+ * patterns straight out of it, without touching the JSON.
+ *
+ * We cache the patterns as loaded. Transformation links and the compiled
+ * transformations are cheap, so Pattern_Vec::mapInto() still builds those.
+ */
+class PatternCache {
+public:
+    /** What we remember about each pattern file. */
+    class FileStamp {
+    public:
+        std::string	relativePath;
+        uint64_t	size = 0;
+        int64_t		modified = 0;		// Nanoseconds since the epoch.
+        uint64_t	hash = 0;
+    };
+
+private:
+    std::string		cacheFileName;
+    std::string		patternsDir;
+
+    void listFiles(std::vector<FileStamp> &stamps) const;
+    bool hashFile(FileStamp &stamp) const;
+
+    static void writePattern(BinaryWriter &writer, const Pattern &pattern);
+    static void readPattern(BinaryReader &reader, Pattern &pattern);
+
+public:
+    PatternCache(const std::string &_cacheFileName, const std::string &_patternsDir);
+
+    bool load(Pattern_Vec &into);
+    void save(const Pattern_Vec &from) const;
+};
+
+} // namespace BeatPatterns
+
+#endif // PATTERNCACHE_H
@@ -12,9 +12,11 @@
 
 #include <boost/filesystem.hpp>
 
+#include <showpage/Profiler.h>
 #include <showpage/StringMethods.h>
 
 #include "Preferences.h"
+#include "PatternCache.h"
 
 using namespace std;
 using JSON = nlohmann::json;
@@ -39,14 +41,17 @@ Preferences::Preferences()
  * Setup to run with the CLI.
  */
 void Preferences::setupForCLI() {
-    unique_lock<mutex> myLock;
+    unique_lock<mutex> myLock(myMytex);
 
     if (s_singleton != nullptr) {
         return;
     }
 
     s_singleton = new Preferences();
-    s_singleton->load();
+    {
+        Profiler::Scope scope("preferencesLoad");
+        s_singleton->load();
+    }
 
     // Can we find the Patterns?
     char const * possibleLocations[] = {
@@ -72,7 +77,7 @@ void Preferences::setupForCLI() {
  */
 Preferences *
 Preferences::getSingleton() {
-    unique_lock<mutex> myLock;
+    unique_lock<mutex> myLock(myMytex);
 
     if (s_singleton == nullptr) {
         s_singleton = new Preferences();
@@ -102,6 +107,7 @@ Preferences::load() {
 
     homeDir = home;
     configFileName = homeDir + "/.BeatPatternsConfig";
+    patternCacheFileName = homeDir + "/.BeatPatternsCache";
     libraryPath = homeDir + "/Music/BeatSaber";
 
     if ( access( configFileName.c_str(), F_OK ) != -1 ) {
@@ -113,12 +119,20 @@ Preferences::load() {
 }
 
 /**
- * Try to load the patterns from this location.
+ * Try to load the patterns from this location. If they haven't changed since
+ * last time, we get them from the cache instead of parsing them all again.
  */
 void
 Preferences::loadPatterns(const std::string &fromDir) {
-    patterns.load(fromDir);
+    Profiler::Scope scope("patternLoad");
+    PatternCache cache(patternCacheFileName, fromDir);
+
+    if (!cache.load(patterns)) {
+        patterns.load(fromDir);
+        cache.save(patterns);
+    }
     patterns.mapInto(patternsMap);
+    patterns.patternsChanged();
 }
 
 /**
@@ -189,11 +203,15 @@ Preferences::toJSON(nlohmann::json &json) const {
 }
 
 /**
- * Get the preferences for this difficulty level.
+ * Get the preferences for this difficulty level. Generators for different
+ * difficulties may ask at the same time, and we might build one, so lock.
  */
 Preferences::DifficultyDefaults &
 Preferences::getDifficultyDefaults(LevelDifficulty difficulty) {
-    return getSingleton()->getOrBuildDifficultyDefaults(difficulty);
+    Preferences * prefs = getSingleton();
+    unique_lock<mutex> myLock(myMytex);
+
+    return prefs->getOrBuildDifficultyDefaults(difficulty);
 }
 
 /**
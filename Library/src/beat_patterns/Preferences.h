@@ -41,6 +41,9 @@ protected:
     /** Location of our config file, saved only if the user makes changes. */
     std::string		configFileName;
 
+    /** Binary copy of the pattern library, so we can skip parsing it. See PatternCache. */
+    std::string		patternCacheFileName;
+
     /**
      * Where do we put all our works in progress?
      * Default: ~/Music/BeatSaber
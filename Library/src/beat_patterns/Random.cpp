@@ -0,0 +1,88 @@
+#include <random>
+
+#include "Random.h"
+
+namespace BeatPatterns {
+
+/**
+ * Used to spread a single seed across our four words of state.
+ */
+static uint64_t splitMix64(uint64_t &value) {
+    uint64_t z = (value += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Constructor. Seeds from the system, so each run is different.
+ */
+Random::Random() {
+    seed(randomSeed());
+}
+
+/**
+ * Constructor with a specific seed, for reproducible output.
+ */
+Random::Random(uint64_t value) {
+    seed(value);
+}
+
+/**
+ * Reseed.
+ */
+void
+Random::seed(uint64_t value) {
+    for (uint64_t &word: state) {
+        word = splitMix64(value);
+    }
+}
+
+/**
+ * Return a seed from the system's random device.
+ */
+uint64_t
+Random::randomSeed() {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) ^ device();
+}
+
+/**
+ * The next raw 64 bits.
+ */
+uint64_t
+Random::next() {
+    uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+    uint64_t t = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = rotateLeft(state[3], 45);
+
+    return result;
+}
+
+/**
+ * A value in [0, 1). We use the top 53 bits, which is all a double can hold.
+ */
+double
+Random::fraction() {
+    return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * A value between a and b.
+ */
+double
+Random::between(double a, double b) {
+    return a + fraction() * (b - a);
+}
+
+} // namespace BeatPatterns
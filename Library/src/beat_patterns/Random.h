@@ -0,0 +1,33 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+namespace BeatPatterns {
+
+/**
+ * A small, fast random number generator (xoshiro256**). Each Generator owns one,
+ * so generators can run in parallel without sharing state, and the same seed
+ * always produces the same map.
+ *
+ * This is not thread-safe. Don't share one between threads.
+ */
+class Random {
+private:
+    uint64_t state[4];
+
+public:
+    Random();
+    Random(uint64_t seed);
+
+    void seed(uint64_t value);
+    static uint64_t randomSeed();
+
+    uint64_t next();
+    double fraction();
+    double between(double a, double b);
+};
+
+} // namespace BeatPatterns
+
+#endif // RANDOM_H
@@ -1,13 +1,25 @@
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <boost/filesystem.hpp>
+#include <showpage/FileUtilities.h>
+#include <showpage/MappedFile.h>
+#include <showpage/Profiler.h>
 #include <showpage/StringMethods.h>
 
 #include "Song.h"
+#include "OggProbe.h"
+#include "BeatmapBinary.h"
 
 using namespace std;
 
@@ -33,9 +45,12 @@ Song::Song()
  */
 int
 Song::open(const std::string fromLocation) {
+    Profiler::Scope scope("songOpen");
     close();
 
-    cout << "Opening song from " << fromLocation << endl;
+    if (verbose) {
+        cout << "Opening song from " << fromLocation << endl;
+    }
 
     boost::filesystem::path path(fromLocation);
 
@@ -49,46 +64,38 @@ Song::open(const std::string fromLocation) {
     }
 
     // Exists and should be a directory.
-    bool didIt = false;
     dirName = path.string();
-    boost::filesystem::directory_iterator end_iter;
     loadedFrom = path.string();
 
-    for ( boost::filesystem::directory_iterator dir_itr( path ); dir_itr != end_iter; ++dir_itr ) {
-        boost::filesystem::path childPath = dir_itr->path();
-
-        if (childPath.filename().string() == "info.dat") {
-            cout << "Must load info from: " << childPath.string() << endl;
-            info.load(childPath.string());
-            didIt = true;
-            break;
+    boost::filesystem::path infoPath = path / "info.dat";
+    if (!boost::filesystem::is_regular_file(infoPath)) {
+        if (verbose) {
+            cout << "Never found an info.date.\n";
         }
+        return -1;
     }
 
-    if (!didIt) {
-        cout << "Never found an info.date.\n";
-        return -1;
+    if (verbose) {
+        cout << "Must load info from: " << infoPath.string() << endl;
     }
+    info.load(infoPath.string());
 
-    // Now load all the existing maps files.
+    // Note where the existing maps are. We read them when they're asked for.
     for (SongDifficultySet *set: info.getDifficultySets()) {
         for (SongDifficulty *songDifficulty: set->difficulties) {
-            SongBeatmapData * beatmapData = beatmapDataMap.get(songDifficulty->beatmapFilename);
-            if (beatmapData == nullptr) {
+            if (!beatmapDataMap.contains(songDifficulty->beatmapFilename)) {
                 string fullPath = path.string() + "/" + songDifficulty->beatmapFilename;
-
-                beatmapData = new SongBeatmapData();
-                beatmapData->load(fullPath);
-
-                beatmapDataMap[songDifficulty->beatmapFilename] = beatmapData;
+                beatmapDataMap[songDifficulty->beatmapFilename] = new SongBeatmapHandle(fullPath);
             }
         }
     }
 
+    // We only need the duration, which we can usually get without starting up SFML.
     if (info.songFilename.length() > 0) {
-        cout << "music.openFromFile( " << dirName + "/" + info.songFilename << " )\n";
-        music.openFromFile(dirName + "/" + info.songFilename);
-        duration = static_cast<double>(music.getDuration().asSeconds());
+        Profiler::Scope probeScope("audioProbe");
+        if (!probeOggDuration(dirName + "/" + info.songFilename, duration) && openMusic()) {
+            duration = static_cast<double>(music.getDuration().asSeconds());
+        }
     }
 
     fixBeatDuration();
@@ -108,21 +115,31 @@ Song::fixBeatDuration() {
  *
  * 		loadedFrom/info.dat		<-- from SongInfo
  * 		loadedFrom/<Normal>.dat	<-- any modified songbeat data.
+ *
+ * Maps nobody asked for were never read, so they can't have changed. We skip those.
  */
 void
 Song::save() {
+    Profiler::Scope scope("save");
     string infoDatFilename = loadedFrom + "/info.dat";
-    info.save(infoDatFilename);
+    info.saveIfChanged(infoDatFilename);
 
     for (SongDifficultySet * diffSet: info.getDifficultySets()) {
         for (SongDifficulty * difficulty: diffSet->difficulties) {
             string filename = difficulty->beatmapFilename;
 
             auto pos = beatmapDataMap.find(filename);
-            if (pos != beatmapDataMap.end()) {
-                SongBeatmapData * beatmapData = pos->second;
-
-                beatmapData->save(loadedFrom + "/" + filename);
+            if (pos != beatmapDataMap.end() && pos->second->isLoaded()) {
+                SongBeatmapData * beatmapData = pos->second->get();
+
+                if (beatmapData->hasChanged() || beatmapData->savedFormat != saveFormat) {
+                    if (saveFormat == BeatmapFormat::Binary) {
+                        beatmapData->saveBinary(loadedFrom + "/" + filename);
+                    }
+                    else {
+                        beatmapData->save(loadedFrom + "/" + filename);
+                    }
+                }
             }
 
         }
@@ -135,7 +152,10 @@ Song::save() {
 void
 Song::close() {
     if (isOpen) {
-        music.stop();
+        if (musicOpened) {
+            music.stop();
+            musicOpened = false;
+        }
         info.clear();
         beatmapDataMap.eraseAll();
 
@@ -146,9 +166,23 @@ Song::close() {
     }
 }
 
+/**
+ * Open the music for playback, if we haven't already.
+ */
+bool
+Song::openMusic() {
+    if (!musicOpened && info.songFilename.length() > 0) {
+        if (verbose) {
+            cout << "music.openFromFile( " << dirName + "/" + info.songFilename << " )\n";
+        }
+        musicOpened = music.openFromFile(dirName + "/" + info.songFilename);
+    }
+    return musicOpened;
+}
+
 void
 Song::startPlaying() {
-    if (isOpen) {
+    if (isOpen && openMusic()) {
         music.play();
     }
 }
@@ -191,33 +225,124 @@ Song::createDifficulty(LevelDifficulty difficulty) {
 
     info.difficultySets.at(0)->difficulties.push_back(sd);
 
-    SongBeatmapData * beatmapData = new SongBeatmapData();
-    beatmapDataMap[sd->beatmapFilename] = beatmapData;
-
+    if (!beatmapDataMap.contains(sd->beatmapFilename)) {
+        beatmapDataMap[sd->beatmapFilename] = new SongBeatmapHandle();
+    }
 
     return sd;
 }
 
 /**
- * Get the beats from this file.
+ * Get the beats from this file, reading them if this is the first time.
  */
 SongBeatmapData *
 Song::getBeatmap(const std::string & filename) {
-    SongBeatmapData * data = nullptr;
-    auto pos = beatmapDataMap.find(filename);
+    SongBeatmapHandle * handle = beatmapDataMap.get(filename);
 
-    if (pos != beatmapDataMap.end()) {
-        data = pos->second;
+    if (handle == nullptr) {
+        handle = new SongBeatmapHandle();
+        beatmapDataMap[filename] = handle;
     }
 
-    else {
-        data = new SongBeatmapData();
-        beatmapDataMap[filename] = data;
+    return handle->get();
+}
+
+/**
+ * Start reading all our maps in the background. Useful if you know you'll
+ * want them all, such as when the GUI opens a song.
+ */
+void
+Song::prefetchBeatmaps() {
+    for (auto &pair: beatmapDataMap) {
+        pair.second->prefetch();
+    }
+}
+
+//======================================================================
+// SongBeatmapHandle
+//======================================================================
+
+/**
+ * Constructor. An empty path means a new, empty map.
+ */
+SongBeatmapHandle::SongBeatmapHandle(const std::string &_fullPath)
+    : fullPath(_fullPath)
+{
+}
+
+/**
+ * Destructor. If we're prefetching, we have to let that finish first.
+ */
+SongBeatmapHandle::~SongBeatmapHandle() {
+    if (prefetching.valid()) {
+        prefetching.wait();
+    }
+    delete data;
+}
+
+/**
+ * Get our data, reading it if we haven't yet. If the read fails, here or in a
+ * prefetch, the exception comes out of here and we stay unloaded, so a bad read
+ * can never be saved over the file.
+ */
+SongBeatmapData *
+SongBeatmapHandle::get() {
+    std::future<void> pending;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (prefetching.valid()) {
+            pending = std::move(prefetching);
+        }
+    }
+
+    // Rethrows anything the prefetch threw.
+    if (pending.valid()) {
+        pending.get();
+    }
+
+    return load();
+}
+
+/**
+ * Read our data if nobody has yet. We only keep it once it has read cleanly.
+ */
+SongBeatmapData *
+SongBeatmapHandle::load() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (data == nullptr) {
+        std::unique_ptr<SongBeatmapData> loaded(new SongBeatmapData());
+        if (fullPath.length() > 0) {
+            loaded->load(fullPath);
+        }
+        data = loaded.release();
     }
 
     return data;
 }
 
+/**
+ * Have we read our data yet?
+ */
+bool
+SongBeatmapHandle::isLoaded() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return data != nullptr;
+}
+
+/**
+ * Start reading in the background. Calling get() in the meantime waits for it,
+ * and throws whatever it threw.
+ */
+void
+SongBeatmapHandle::prefetch() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if (data == nullptr && !prefetching.valid()) {
+        prefetching = std::async(std::launch::async, [this]() { load(); });
+    }
+}
+
 
 
 //======================================================================
@@ -225,13 +350,21 @@ Song::getBeatmap(const std::string & filename) {
 //======================================================================
 
 /**
- * Load our contents from a file. It's in JSON.
+ * Load our contents from a file. It's in JSON, which we parse where it sits. Throws
+ * if we can't read the file.
  */
 void SongInfo::load(const std::string &fileName) {
-    string contents = readFileContents(fileName);
-    nlohmann::json json = nlohmann::json::parse(contents);
+    MappedFile file;
+    if (!file.open(fileName)) {
+        throw std::runtime_error("Can't open " + fileName);
+    }
+    nlohmann::json json = nlohmann::json::parse(nlohmann::detail::input_adapter(file.data(), file.size()));
 
     fromJSON(json);
+
+    JSON loaded;
+    toJSON(loaded);
+    savedContentHash = std::hash<string>()(loaded.dump(2));
 }
 
 void
@@ -239,13 +372,38 @@ SongInfo::save(const std::string &filename) {
     JSON json;
 
     toJSON(json);
+    write(filename, json.dump(2));
+}
+
+/**
+ * Save, but only if something changed since we last read or wrote. Returns true if we wrote.
+ */
+bool
+SongInfo::saveIfChanged(const std::string &filename) {
+    JSON json;
+
+    toJSON(json);
+    string contents = json.dump(2);
+    if (savedContentHash != 0 && std::hash<string>()(contents) == savedContentHash) {
+        return false;
+    }
+
+    write(filename, contents);
+    return true;
+}
+
+void
+SongInfo::write(const std::string &filename, const std::string &contents) {
     ofstream output(filename);
-    output << json.dump(2);
+    output << contents;
     output.close();
+
+    savedContentHash = std::hash<string>()(contents);
 }
 
 void SongInfo::clear() {
     difficultySets.eraseAll();
+    savedContentHash = 0;
 }
 
 /**
@@ -297,7 +455,7 @@ void SongInfo::fromJSON(const nlohmann::json & json) {
     rowHeight = intValue(mappingExtensions, "rowHeight");
 
     // Beatmap sets.
-    static nlohmann::json difficultySetsJson = jsonValue(json, "_difficultyBeatmapSets");
+    nlohmann::json difficultySetsJson = jsonValue(json, "_difficultyBeatmapSets");
     difficultySets.fromJSON(difficultySetsJson);
 }
 
@@ -443,22 +601,348 @@ void SongDifficultySet_Vec::toJSON(nlohmann::json & json) const {
 //======================================================================
 
 /**
- * Load from this file.
+ * This streams a beatmap straight into a SongBeatmapData without building a DOM.
+ *
+ * Our copy of nlohmann::json predates the SAX interface, so we use the parser
+ * callback instead. Each scalar inside a note or event is copied into the record
+ * we're building and then discarded, and each finished note or event object is
+ * pushed and discarded, so the parser never holds more than one element at a time.
+ * Everything we don't understand (_obstacles, _BPMChanges, _customData and the
+ * like) is thrown away a value at a time the same way.
+ *
+ * We accept every object and array when it starts, even ones we don't want, and
+ * drop them when they end. Our parser raises its depth when we reject a container
+ * at its start but never lowers it again, which would throw off every depth after.
+ *
+ * Depths as the parser reports them:
+ *
+ * 		1		the top-level keys and values (_version, _notes, _events)
+ * 		2		the note / event objects inside the arrays
+ * 		3		the keys and values inside a single note / event
+ *
+ * Anything deeper is inside something we skip, such as a note's _customData.
+ */
+class BeatmapStreamLoader {
+private:
+    SongBeatmapData &	data;
+
+    /** Which top-level array are we inside? */
+    std::string			section;
+
+    /** The key we're about to see a value for inside a note or event. */
+    std::string			field;
+
+    SongBeatmapData::Note	note;
+    SongBeatmapData::Event	event;
+
+    bool handle(int depth, JSON::parse_event_t eventType, JSON &parsed);
+    void resetRecords();
+    void setNoteField(const JSON &value);
+    void setEventField(const JSON &value);
+
+public:
+    BeatmapStreamLoader(SongBeatmapData &_data): data(_data) { resetRecords(); }
+
+    void load(const char *text, size_t length);
+};
+
+/**
+ * Run the parse over the file's text, in place.
+ */
+void BeatmapStreamLoader::load(const char *text, size_t length) {
+    JSON::parse(nlohmann::detail::input_adapter(text, length), [this](int depth, JSON::parse_event_t eventType, JSON &parsed) {
+        return handle(depth, eventType, parsed);
+    });
+}
+
+/**
+ * This is our parser callback. Returning false tells the parser to throw away
+ * (or not bother building) the value it just reported.
+ */
+bool BeatmapStreamLoader::handle(int depth, JSON::parse_event_t eventType, JSON &parsed) {
+    bool inRecords = section == "_notes" || section == "_events";
+
+    switch (eventType) {
+        case JSON::parse_event_t::key:
+            if (depth == 1) {
+                section = parsed.get_ref<const std::string &>();
+            }
+            else if (depth == 3) {
+                field = parsed.get_ref<const std::string &>();
+            }
+            return true;
+
+        // Always accepted, so the parser's depth stays right. See above.
+        case JSON::parse_event_t::object_start:
+        case JSON::parse_event_t::array_start:
+            return true;
+
+        case JSON::parse_event_t::value:
+            if (depth == 1 && section == "_version" && parsed.is_string()) {
+                data.version = parsed.get_ref<const std::string &>();
+            }
+            else if (depth == 3 && inRecords && !parsed.is_null()) {
+                if (section == "_notes") {
+                    setNoteField(parsed);
+                }
+                else {
+                    setEventField(parsed);
+                }
+            }
+            return false;
+
+        case JSON::parse_event_t::object_end:
+            if (depth == 2 && inRecords) {
+                if (section == "_notes") {
+                    data.notes.push_back(note);
+                }
+                else {
+                    data.events.push_back(event);
+                }
+                resetRecords();
+            }
+            return false;
+
+        case JSON::parse_event_t::array_end:
+            return false;
+    }
+
+    return false;
+}
+
+/**
+ * Start fresh for the next note or event. Missing fields read as zero, same as intValue().
+ */
+void BeatmapStreamLoader::resetRecords() {
+    note = SongBeatmapData::Note();
+    event = SongBeatmapData::Event();
+}
+
+void BeatmapStreamLoader::setNoteField(const JSON &value) {
+    if (field == "_time") note.time = value.get<double>();
+    else if (field == "_lineIndex") note.lineIndex = value.get<int>();
+    else if (field == "_lineLayer") note.lineLayer = value.get<int>();
+    else if (field == "_type") note.type = value.get<int>();
+    else if (field == "_cutDirection") note.cutDirection = value.get<int>();
+}
+
+void BeatmapStreamLoader::setEventField(const JSON &value) {
+    if (field == "_time") event.time = value.get<double>();
+    else if (field == "_type") event.type = value.get<int>();
+    else if (field == "_value") event.value = value.get<int>();
+}
+
+/**
+ * Load from this file. If there's a binary copy beside it that's at least as new,
+ * we read that instead. Otherwise we stream the JSON rather than parsing a DOM,
+ * straight out of the mapped file for a large map. Throws if we can't read the file.
  */
 void SongBeatmapData::load(const std::string &fileName) {
-    string contents = readFileContents(fileName);
-    nlohmann::json json = nlohmann::json::parse(contents);
+    string binaryName = BeatmapBinary::sidecarName(fileName);
+    uint64_t size = 0;
+    int64_t binaryModified = 0;
+    int64_t datModified = 0;
+
+    if (FileUtilities::statFile(binaryName, size, binaryModified)) {
+        bool haveDat = FileUtilities::statFile(fileName, size, datModified);
+
+        if ((!haveDat || binaryModified >= datModified) && BeatmapBinary::load(*this, binaryName)) {
+            ++generation;
+            savedGeneration = generation;
+            savedFormat = BeatmapFormat::Binary;
+            return;
+        }
+    }
 
-    fromJSON(json);
+    MappedFile file;
+    if (!file.open(fileName)) {
+        throw std::runtime_error("Can't open " + fileName);
+    }
+
+    BeatmapStreamLoader loader(*this);
+    loader.load(file.data(), file.size());
+    ++generation;
+    savedGeneration = generation;
+    savedFormat = BeatmapFormat::JSON;
+}
+
+/**
+ * This writes a beatmap straight from a SongBeatmapData without building a DOM.
+ *
+ * The output is byte for byte what toJSON() followed by dump() would give us: a single
+ * line, keys in sorted order, and doubles formatted by the same shortest round-trip
+ * routine dump() uses. Everything goes through one large buffer that we hand to the
+ * stream whenever it fills.
+ */
+class BeatmapWriter {
+private:
+    static const size_t BufferSize = 1024 * 1024;
+
+    std::ofstream		output;
+    std::vector<char>	buffer;
+    size_t				used = 0;
+
+    void flush();
+    void reserve(size_t length) { if (used + length > BufferSize) flush(); }
+
+    void put(const char *text, size_t length);
+    void put(const char *text) { put(text, strlen(text)); }
+    void putInt(int value);
+    void putDouble(double value);
+
+    void writeEvent(const SongBeatmapData::Event &event);
+    void writeNote(const SongBeatmapData::Note &note);
+
+public:
+    BeatmapWriter(const std::string &filename);
+
+    bool write(const SongBeatmapData &data);
+};
+
+BeatmapWriter::BeatmapWriter(const std::string &filename)
+    : output(filename, ios::binary | ios::trunc), buffer(BufferSize)
+{
+}
+
+void BeatmapWriter::flush() {
+    output.write(buffer.data(), static_cast<std::streamsize>(used));
+    used = 0;
+}
+
+void BeatmapWriter::put(const char *text, size_t length) {
+    if (length > BufferSize) {
+        flush();
+        output.write(text, static_cast<std::streamsize>(length));
+        return;
+    }
+    reserve(length);
+    memcpy(buffer.data() + used, text, length);
+    used += length;
+}
+
+void BeatmapWriter::putInt(int value) {
+    char digits[16];
+    char *end = digits + sizeof(digits);
+    char *pos = end;
+    unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+
+    do {
+        *--pos = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+
+    if (value < 0) {
+        *--pos = '-';
+    }
+    put(pos, static_cast<size_t>(end - pos));
+}
+
+/**
+ * Same as dump(): NaN and infinity become null.
+ */
+void BeatmapWriter::putDouble(double value) {
+    if (!std::isfinite(value)) {
+        put("null", 4);
+        return;
+    }
+
+    char digits[64];
+    char *end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), value);
+    put(digits, static_cast<size_t>(end - digits));
 }
 
+void BeatmapWriter::writeEvent(const SongBeatmapData::Event &event) {
+    put("{\"_time\":");
+    putDouble(event.time);
+    put(",\"_type\":");
+    putInt(event.type);
+    put(",\"_value\":");
+    putInt(event.value);
+    put("}", 1);
+}
+
+void BeatmapWriter::writeNote(const SongBeatmapData::Note &note) {
+    put("{\"_cutDirection\":");
+    putInt(note.cutDirection);
+    put(",\"_lineIndex\":");
+    putInt(note.lineIndex);
+    put(",\"_lineLayer\":");
+    putInt(note.lineLayer);
+    put(",\"_time\":");
+    putDouble(note.time);
+    put(",\"_type\":");
+    putInt(note.type);
+    put("}", 1);
+}
+
+/**
+ * Write the whole map. Returns false if anything went wrong with the file.
+ */
+bool BeatmapWriter::write(const SongBeatmapData &data) {
+    if (!output) {
+        return false;
+    }
+
+    put("{\"_events\":[");
+    for (size_t index = 0; index < data.events.size(); ++index) {
+        if (index > 0) {
+            put(",", 1);
+        }
+        writeEvent(data.events[index]);
+    }
+
+    put("],\"_notes\":[");
+    for (size_t index = 0; index < data.notes.size(); ++index) {
+        if (index > 0) {
+            put(",", 1);
+        }
+        writeNote(data.notes[index]);
+    }
+
+    // The version is the only string, so let the library worry about escaping it.
+    put("],\"_version\":");
+    string version = JSON(data.version).dump();
+    put(version.data(), version.size());
+    put("}", 1);
+
+    flush();
+    output.close();
+    return !output.fail();
+}
+
+/**
+ * Save to this file. We write a temporary file beside it and rename it into place,
+ * so a crash part way through leaves the old map alone.
+ *
+ * We do NOT pretty-print, as we expect a single line, and it might matter.
+ */
 void
 SongBeatmapData::save(const std::string &filename) {
-    JSON json;
-    toJSON(json);
-    ofstream output(filename);
-    output << json.dump();		// Do NOT do pretty-print, as we expect a single line, and it might matter.
-    output.close();
+    string tempName = filename + ".tmp";
+    BeatmapWriter writer(tempName);
+
+    if (!writer.write(*this) || std::rename(tempName.c_str(), filename.c_str()) != 0) {
+        cout << "Unable to write beatmap " << filename << endl;
+        std::remove(tempName.c_str());
+        return;
+    }
+    savedGeneration = generation;
+
+    // The .dat is the map now. Don't leave an older binary copy to be read instead.
+    std::remove(BeatmapBinary::sidecarName(filename).c_str());
+    savedFormat = BeatmapFormat::JSON;
+}
+
+/**
+ * Save our binary copy beside this .dat (see BeatmapBinary). The .dat itself is
+ * left alone until someone saves as JSON.
+ */
+void
+SongBeatmapData::saveBinary(const std::string &fileName) {
+    if (BeatmapBinary::save(*this, BeatmapBinary::sidecarName(fileName))) {
+        savedGeneration = generation;
+        savedFormat = BeatmapFormat::Binary;
+    }
 }
 
 /**
@@ -491,161 +975,284 @@ void SongBeatmapData::toJSON(nlohmann::json & json) const {
 }
 
 /**
- * Run through the data and see what the largest gap is.
+ * Gather all the map statistics in one pass over the notes. The result is cached
+ * until the notes change (see markChanged()) or we're asked about a different
+ * song length or BPM, so the notes table can refresh as often as it likes.
+ *
+ * The direction and type tallies are table lookups rather than comparisons, so
+ * the loop body has no data-dependent branches.
  */
-double SongBeatmapData::largestGap(double songLength, int bpm) const {
-    double retVal = 0.0;
+SongBeatmapData::MapStats
+SongBeatmapData::computeStats(double songLength, int bpm) const {
+    if (cachedStatsGeneration == generation
+            && cachedStats.songLength == songLength
+            && cachedStats.bpm == bpm
+            && cachedStats.noteCount == static_cast<int>(notes.size())) {
+        return cachedStats;
+    }
+
+    MapStats stats;
+    double secondsPerBeat = bpm > 0 ? 60.0 / static_cast<double>(bpm) : 0.0;
     double timeOfLastNote = 0.0;
-    double secondsPerBeat = static_cast<double>(bpm) / 60.0;
-    double delta;
 
-    for (Note * note: notes) {
-        double thisTime = secondsPerBeat * note->time;
+    // Types are 0 (red), 1 (blue) and 3 (bomb). Anything else lands in slot 2.
+    int typeCounts[4] = {};
 
-        delta = thisTime - timeOfLastNote;
-        if (delta > retVal) {
-            retVal = delta;
-        }
+    // One extra slot at the end catches out-of-range directions.
+    int directionCounts[NoteDirection_None + 2] = {};
+
+    for (const Note & note: notes) {
+        double thisTime = secondsPerBeat * note.time;
+        double delta = thisTime - timeOfLastNote;
+
+        stats.largestGap = delta > stats.largestGap ? delta : stats.largestGap;
+        stats.numberLargeGaps += delta > LargeGapSeconds ? 1 : 0;
         timeOfLastNote = thisTime;
+
+        unsigned int type = static_cast<unsigned int>(note.type);
+        unsigned int direction = static_cast<unsigned int>(note.cutDirection);
+
+        ++typeCounts[type < 4 ? type : 2];
+        ++directionCounts[direction <= NoteDirection_None ? direction : NoteDirection_None + 1];
     }
 
-    delta = songLength - timeOfLastNote;
-    if (delta > retVal) {
-        retVal = delta;
+    double delta = songLength - timeOfLastNote;
+    stats.largestGap = delta > stats.largestGap ? delta : stats.largestGap;
+    stats.numberLargeGaps += delta > LargeGapSeconds ? 1 : 0;
+
+    stats.noteCount = static_cast<int>(notes.size());
+    stats.redCuts = typeCounts[NoteType_Red];
+    stats.blueCuts = typeCounts[NoteType_Blue];
+    stats.bombCount = typeCounts[3];
+
+    for (int index = 0; index <= NoteDirection_None; ++index) {
+        stats.directionCounts[index] = directionCounts[index];
     }
+    stats.upDownCuts = directionCounts[NoteDirection_Up] + directionCounts[NoteDirection_Down];
+    stats.leftRightCuts = directionCounts[NoteDirection_Left] + directionCounts[NoteDirection_Right];
+    stats.diagonalCuts = directionCounts[NoteDirection_UpLeft] + directionCounts[NoteDirection_UpRight]
+            + directionCounts[NoteDirection_DownLeft] + directionCounts[NoteDirection_DownRight];
+
+    stats.songLength = songLength;
+    stats.bpm = bpm;
+
+    cachedStats = stats;
+    cachedStatsGeneration = generation;
+
+    return stats;
+}
 
-    return retVal;
+/**
+ * Run through the data and see what the largest gap is, in seconds.
+ */
+double SongBeatmapData::largestGap(double songLength, int bpm) const {
+    return computeStats(songLength, bpm).largestGap;
 }
 
 /**
  * How many large gaps are there?
  */
 int SongBeatmapData::numberLargeGaps(double songLength, int bpm) const {
-    int rv = 0;
-    double secondsPerBeat = static_cast<double>(bpm) / 60.0;
-    double timeOfLastNote = 0.0;
-
-    for (Note * note: notes) {
-        double thisTime = secondsPerBeat * note->time;
+    return computeStats(songLength, bpm).numberLargeGaps;
+}
 
-        if (thisTime - timeOfLastNote > 5.0) {
-            ++rv;
-        }
+/**
+ * The cached stats, recomputed for the same song length and BPM if the notes have
+ * changed. The counts below don't depend on either.
+ */
+const SongBeatmapData::MapStats &
+SongBeatmapData::currentStats() const {
+    computeStats(cachedStats.songLength, cachedStats.bpm);
+    return cachedStats;
+}
 
-        timeOfLastNote = thisTime;
+int SongBeatmapData::getCutsCount(CubeType cubeType) const {
+    switch (cubeType) {
+        case CubeType::Red: return currentStats().redCuts;
+        case CubeType::Blue: return currentStats().blueCuts;
+        case CubeType::Bomb: return currentStats().bombCount;
     }
 
-    if (songLength - timeOfLastNote > 5.0) {
-        ++rv;
-    }
+    // Won't get here.
+    return 0;
+}
 
-    return rv;
+int SongBeatmapData::getUpDownCuts() const {
+    return currentStats().upDownCuts;
 }
 
-int SongBeatmapData::getCutsCount(CubeType cubeType) const {
-    int rv = 0;
-    int cubeTypeInt = cubeTypeToInt(cubeType);
+int SongBeatmapData::getLeftRightCuts() const {
+    return currentStats().leftRightCuts;
+}
 
-    for (Note *note: notes) {
-        if (note->type == cubeTypeInt) {
-            ++rv;
-        }
-    }
-    return rv;
+int SongBeatmapData::getDiagonalCuts() const {
+    return currentStats().diagonalCuts;
 }
 
-int SongBeatmapData::getUpDownCuts() const {
-    int rv = 0;
-    for (Note *note: notes) {
-        if (note->cutDirection == NoteDirection_Up || note->cutDirection == NoteDirection_Down) {
-            ++rv;
-        }
-    }
-    return rv;
+/**
+ * Return the index to the next note at or after this time.
+ */
+int SongBeatmapData::indexAfter(double time) const {
+    return lowerBound(time);
 }
 
-int SongBeatmapData::getLeftRightCuts() const {
-    int rv = 0;
-    for (Note *note: notes) {
-        if (note->cutDirection == NoteDirection_Left || note->cutDirection == NoteDirection_Right) {
-            ++rv;
-        }
+/**
+ * Get the time index, building it if the notes have changed since last time.
+ */
+const SongBeatmapData::TimeIndex &
+SongBeatmapData::getTimeIndex() const {
+    if (cachedTimeIndexGeneration != generation || cachedTimeIndex.timeOf.size() != notes.size()) {
+        cachedTimeIndex.build(notes);
+        cachedTimeIndexGeneration = generation;
     }
-    return rv;
+    return cachedTimeIndex;
 }
 
-int SongBeatmapData::getDiagonalCuts() const {
-    int rv = 0;
-    for (Note *note: notes) {
-        if (note->cutDirection == NoteDirection_UpLeft || note->cutDirection == NoteDirection_UpRight
-                || note->cutDirection == NoteDirection_DownLeft || note->cutDirection == NoteDirection_DownRight) {
-            ++rv;
-        }
+/**
+ * The index of the first note at or after this time, or notes.size() if there isn't one.
+ */
+int SongBeatmapData::lowerBound(double time) const {
+    const TimeIndex & index = getTimeIndex();
+    auto pos = std::lower_bound(index.times.cbegin(), index.times.cend(), time);
+
+    return index.firstNote[pos - index.times.cbegin()];
+}
+
+/**
+ * The notes from fromTime up to but not including toTime, as [first, end) indexes.
+ */
+std::pair<int, int> SongBeatmapData::notesBetween(double fromTime, double toTime) const {
+    int first = lowerBound(fromTime);
+    int end = toTime > fromTime ? lowerBound(toTime) : first;
+
+    return std::make_pair(first, end);
+}
+
+/**
+ * The index of the first note later than the one at this index (skipping the rest
+ * of its chord), or notes.size() if there isn't one. -1 gives the first note.
+ */
+int SongBeatmapData::nextTimeIndex(int index) const {
+    const TimeIndex & timeIndex = getTimeIndex();
+
+    if (index < 0) {
+        return 0;
+    }
+    if (index >= static_cast<int>(notes.size())) {
+        return static_cast<int>(notes.size());
     }
-    return rv;
+    return timeIndex.firstNote[timeIndex.timeOf[index] + 1];
 }
 
 /**
- * Return the index to the next note after this time.
+ * The index of the first note in the chord before the one at this index, or -1.
  */
-int SongBeatmapData::indexAfter(double time) const {
-    int index = notes.binarySearchForIndex( [=](Note *note) {
-        double diff = (note->time - time) * 1000;
-        return static_cast<int>(diff);
-    }, true, 0, 0);
+int SongBeatmapData::previousTimeIndex(int index) const {
+    const TimeIndex & timeIndex = getTimeIndex();
+
+    if (index <= 0 || timeIndex.times.empty()) {
+        return -1;
+    }
+
+    int time = index < static_cast<int>(notes.size())
+            ? timeIndex.timeOf[index] - 1
+            : static_cast<int>(timeIndex.times.size()) - 1;
 
-    return index;
+    return time >= 0 ? timeIndex.firstNote[time] : -1;
 }
 
 SongBeatmapData::Note * SongBeatmapData::getNote(int index) {
-    if (index >= 0 && index < notes.size()) {
-        return notes.at(index);
+    if (index >= 0 && index < static_cast<int>(notes.size())) {
+        return &notes.at(index);
     }
     return nullptr;
 }
 
+/**
+ * The closest note at least StepBeats before this one.
+ */
 SongBeatmapData::Note * SongBeatmapData::getPreviousNote(int index) {
-    if (index <= 0) {
+    if (index <= 0 || index >= static_cast<int>(notes.size())) {
         return nullptr;
     }
-    Note & baseNote = *notes.at(index);
-
-    for (int searchIndex = index - 1; searchIndex >= 0; --searchIndex) {
-        Note & thisNote = *notes.at(searchIndex);
-        double delta = baseNote.time - thisNote.time;
 
-        // We only want to return it if it's at least 1/10th of a beat earlier.
-        if (delta > 0.1) {
-            return &thisNote;
-        }
+    const TimeIndex & timeIndex = getTimeIndex();
+    int time = timeIndex.previousStep[timeIndex.timeOf[index]];
+    if (time < 0) {
+        return nullptr;
     }
 
-    return nullptr;
+    // The last note at that time, as it's the closest one.
+    return &notes.at(timeIndex.firstNote[time + 1] - 1);
 }
 
+/**
+ * The first note at least StepBeats after this one. With a negative index, the
+ * first note at least StepBeats into the song.
+ */
 SongBeatmapData::Note * SongBeatmapData::getNextNote(int index) {
-    if (index < 0) {
-        index = -1;
-    }
-
     // Have to only compare against size if index is non-negative due to
     // automatic typecasting when comparing against an unsigned long.
-    if (index >= 0 && index >= notes.size()) {
+    if (index >= 0 && index >= static_cast<int>(notes.size())) {
         return nullptr;
     }
 
-    double compareToTime = index >= 0 ? notes.at(index)->time : 0.0;
-    for (int searchIndex = index + 1; searchIndex < notes.size(); ++searchIndex) {
-        Note & thisNote = *notes.at(searchIndex);
-        double delta = thisNote.time - compareToTime;
+    const TimeIndex & timeIndex = getTimeIndex();
+    int time;
+
+    if (index < 0) {
+        double firstStep = StepBeats;
+        time = static_cast<int>(std::upper_bound(timeIndex.times.cbegin(), timeIndex.times.cend(), firstStep) - timeIndex.times.cbegin());
+    }
+    else {
+        time = timeIndex.nextStep[timeIndex.timeOf[index]];
+    }
+
+    if (time >= static_cast<int>(timeIndex.times.size())) {
+        return nullptr;
+    }
+    return &notes.at(timeIndex.firstNote[time]);
+}
 
-        // We only want to return it if it's at least 1/10th of a beat later.
-        if (delta > 0.1) {
-            return &thisNote;
+/**
+ * Build from these notes, which must be in time order. Everything is one pass,
+ * as the previous and next step only ever move forward.
+ */
+void SongBeatmapData::TimeIndex::build(const Note_Vec &notes) {
+    times.clear();
+    firstNote.clear();
+    timeOf.clear();
+    timeOf.reserve(notes.size());
+
+    for (size_t index = 0; index < notes.size(); ++index) {
+        if (times.empty() || notes[index].time != times.back()) {
+            times.push_back(notes[index].time);
+            firstNote.push_back(static_cast<int>(index));
         }
+        timeOf.push_back(static_cast<int>(times.size()) - 1);
     }
+    firstNote.push_back(static_cast<int>(notes.size()));
 
-    return nullptr;
+    int count = static_cast<int>(times.size());
+    previousStep.resize(times.size());
+    nextStep.resize(times.size());
+
+    int previous = -1;
+    int next = 0;
+    for (int time = 0; time < count; ++time) {
+        while (previous + 1 < time && times[time] - times[previous + 1] > StepBeats) {
+            ++previous;
+        }
+        previousStep[time] = previous;
+
+        if (next <= time) {
+            next = time + 1;
+        }
+        while (next < count && !(times[next] - times[time] > StepBeats)) {
+            ++next;
+        }
+        nextStep[time] = next;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -670,30 +1277,6 @@ void SongBeatmapData::Event::toJSON(nlohmann::json &json) const {
     json["_value"] = value;
 }
 
-/**
- * Read the Event Vector from this JSON.
- */
-void SongBeatmapData::Event_Vec::fromJSON(const nlohmann::json &array) {
-    for (auto iter = array.begin(); iter != array.end(); ++iter) {
-        nlohmann::json obj = *iter;
-
-        SongBeatmapData::Event * event = new SongBeatmapData::Event();
-        event->fromJSON(obj);
-        push_back(event);
-    }
-}
-
-/**
- * Output the Event Vector to JSON.
- */
-void SongBeatmapData::Event_Vec::toJSON(nlohmann::json & json) const {
-    for (SongBeatmapData::Event *event: *this) {
-        nlohmann::json childJson = nlohmann::json::object();
-        event->toJSON(childJson);
-        json.push_back(childJson);
-    }
-}
-
 /**
  * Read the Note from this JSON.
  */
@@ -716,30 +1299,6 @@ void SongBeatmapData::Note::toJSON(nlohmann::json & json) const {
     json["_cutDirection"] = cutDirection;
 }
 
-/**
- * Read the Note Vector from this JSON.
- */
-void SongBeatmapData::Note_Vec::fromJSON(const nlohmann::json &array) {
-    for (auto iter = array.begin(); iter != array.end(); ++iter) {
-        nlohmann::json obj = *iter;
-
-        SongBeatmapData::Note * note = new SongBeatmapData::Note();
-        note->fromJSON(obj);
-        push_back(note);
-    }
-}
-
-/**
- * Output the Event Vector to JSON.
- */
-void SongBeatmapData::Note_Vec::toJSON(nlohmann::json & json) const {
-    for (SongBeatmapData::Note *note: *this) {
-        nlohmann::json childJson = nlohmann::json::object();
-        note->toJSON(childJson);
-        json.push_back(childJson);
-    }
-}
-
 
 
 }
@@ -2,6 +2,10 @@
 #define SONG_H
 
 #include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <future>
 #include <SFML/Audio.hpp>
 
 #include <showpage/JSON_Serializable.h>
@@ -12,6 +16,15 @@
 
 namespace BeatPatterns {
 
+/**
+ * How we save beatmaps: the .dat JSON that Beat Saber reads, or our binary copy
+ * beside it (see BeatmapBinary), for maps that aren't done yet.
+ */
+enum class BeatmapFormat {
+    JSON,
+    Binary
+};
+
 /**
  * This is what appears in Normal.dat
  */
@@ -20,55 +33,148 @@ class SongBeatmapData: public JSON_Serializable {
 public:
     class Event: public JSON_Serializable {
     public:
-        double time;
-        int type;
-        int value;
+        double time = 0.0;
+        int type = 0;
+        int value = 0;
 
         void fromJSON(const nlohmann::json & json);
         void toJSON(nlohmann::json & json) const;
     };
 
-    class Event_Vec: public PointerVector<Event>, public JSON_Serializable {
-    public:
-        void fromJSON(const nlohmann::json & json);
-        void toJSON(nlohmann::json & json) const;
+    /** Events are stored by value so a whole lightshow is one contiguous block. */
+    class Event_Vec: public JSON_Serializable_Vector<Event> {
     };
 
     class Note: public JSON_Serializable {
     public:
-        double time;
-        int lineIndex;
-        int lineLayer;
-        int type;
-        int cutDirection;
+        double time = 0.0;
+        int lineIndex = 0;
+        int lineLayer = 0;
+        int type = 0;
+        int cutDirection = 0;
 
         void fromJSON(const nlohmann::json & json);
         void toJSON(nlohmann::json & json) const;
     };
 
-    class Note_Vec: public PointerVector<Note>, public JSON_Serializable {
+    /**
+     * Notes are stored by value, in time order, so the analytics passes are linear
+     * sweeps over one contiguous block and loading or generating a map doesn't
+     * allocate per note. Pointers from getNote() and friends are only good until
+     * the next insert or erase.
+     */
+    class Note_Vec: public JSON_Serializable_Vector<Note> {
+    };
+
+    /**
+     * Everything the notes table shows about a map, gathered in one pass by computeStats().
+     */
+    class MapStats {
     public:
-        void fromJSON(const nlohmann::json & json);
-        void toJSON(nlohmann::json & json) const;
+        int noteCount = 0;
+        int redCuts = 0;
+        int blueCuts = 0;
+        int bombCount = 0;
+        int upDownCuts = 0;
+        int leftRightCuts = 0;
+        int diagonalCuts = 0;
+
+        /** Indexed by the NoteDirection_* constants. */
+        int directionCounts[NoteDirection_None + 1] = {};
+
+        /** In seconds. */
+        double largestGap = 0.0;
+        int numberLargeGaps = 0;
+
+        // What these were computed for, so we know when the cache is stale.
+        double songLength = 0.0;
+        int bpm = 0;
+    };
+
+    /**
+     * Where each distinct note time sits in the notes, so the editor can step through
+     * a map without scanning it. Notes at exactly the same time (a chord) share one
+     * entry. Built by getTimeIndex() and kept until the notes change.
+     */
+    class TimeIndex {
+    public:
+        /** Each distinct note time, in order. */
+        std::vector<double> times;
+
+        /** The notes at times[i] run from firstNote[i] up to firstNote[i + 1]. There's one extra entry at the end. */
+        std::vector<int> firstNote;
+
+        /** For each note, which entry in times it belongs to. */
+        std::vector<int> timeOf;
+
+        /**
+         * For each entry in times, the nearest one at least StepBeats earlier or later.
+         * -1 or times.size() if there isn't one.
+         */
+        std::vector<int> previousStep;
+        std::vector<int> nextStep;
+
+        void build(const Note_Vec &notes);
     };
 
+    /** Gaps longer than this (in seconds) count as large. */
+    static constexpr double LargeGapSeconds = 5.0;
+
+    /** Stepping to the previous or next note skips anything closer than this many beats. */
+    static constexpr double StepBeats = 0.1;
+
+private:
+    mutable MapStats cachedStats;
+    mutable unsigned long cachedStatsGeneration = 0;
+
+    const MapStats & currentStats() const;
+
+    mutable TimeIndex cachedTimeIndex;
+    mutable unsigned long cachedTimeIndexGeneration = 0;
+
 public:
     std::string version;
     Event_Vec events;
     Note_Vec notes;
-    bool hasChanged = false;
+
+    /**
+     * Bumped every time the notes change so we can cache things computed from them.
+     * If you edit notes directly, call markChanged().
+     */
+    unsigned long generation = 1;
+
+    /** The generation we last read or wrote. A map we create starts out unsaved. */
+    unsigned long savedGeneration = 0;
+
+    /**
+     * Which file holds what we last read or wrote: the .dat, or the binary copy
+     * beside it. Saving in the other format has to write even if we haven't changed.
+     */
+    BeatmapFormat savedFormat = BeatmapFormat::JSON;
 
 public:
     void load(const std::string &fileName);
     void save(const std::string &fileName);
+    void saveBinary(const std::string &fileName);
 
     void fromJSON(const nlohmann::json & json);
     void toJSON(nlohmann::json & json) const;
 
+    void markChanged() { ++generation; }
+    bool hasChanged() const { return generation != savedGeneration; }
+
+    MapStats computeStats(double songLength, int bpm) const;
+
     double largestGap(double songLength, int bpm) const;
     int numberLargeGaps(double songLength, int bpm) const;
     int indexAfter(double time) const;
 
+    const TimeIndex & getTimeIndex() const;
+    int lowerBound(double time) const;
+    std::pair<int, int> notesBetween(double fromTime, double toTime) const;
+    int nextTimeIndex(int index) const;
+    int previousTimeIndex(int index) const;
+
     int getCutsCount(CubeType) const;
     int getUpDownCuts() const;
     int getLeftRightCuts() const;
@@ -169,9 +275,20 @@ public:
     // _difficultyBeatmapSets array
     SongDifficultySet_Vec difficultySets;
 
+private:
+    /**
+     * Hash of what we last read or wrote, as we'd write it. Our fields are public,
+     * so rather than ask everyone to mark us changed, we compare against this.
+     * Zero means we've never been read or written.
+     */
+    size_t savedContentHash = 0;
+
+    void write(const std::string &fileName, const std::string &contents);
+
 public:
     void load(const std::string &fileName);
     void save(const std::string &fileName);
+    bool saveIfChanged(const std::string &fileName);
     void clear();
 
     void fromJSON(const nlohmann::json & json);
@@ -181,6 +298,32 @@ public:
 };
 
 
+/**
+ * One entry in Song::beatmapDataMap. Opening a song doesn't read its maps; we
+ * read each one the first time someone asks for it. You can also ask us to
+ * start reading in the background with prefetch(), and get() waits for it.
+ */
+class SongBeatmapHandle
+{
+private:
+    /** Where to read from. Empty for a map we created and haven't saved. */
+    std::string			fullPath;
+
+    std::mutex			mutex;
+    SongBeatmapData *	data = nullptr;
+    std::future<void>	prefetching;
+
+    SongBeatmapData * load();
+
+public:
+    SongBeatmapHandle(const std::string &_fullPath = std::string());
+    ~SongBeatmapHandle();
+
+    SongBeatmapData * get();
+    bool isLoaded();
+    void prefetch();
+};
+
 /**
  * This is all the information about a song.
  */
@@ -191,11 +334,19 @@ private:
 
     std::string			loadedFrom;
 
+    /** Have we opened the music in SFML yet? We only do that to play it. */
+    bool				musicOpened = false;
+
 public:
     SongInfo	info;
-    PointerMap<std::string, SongBeatmapData> beatmapDataMap;
 
-    /** This is the SFML object that holds our music. We need this for data and for playback. */
+    /** Keyed by beatmap filename. Use getBeatmap(), which reads the map if we haven't yet. */
+    PointerMap<std::string, SongBeatmapHandle> beatmapDataMap;
+
+    /**
+     * This is the SFML object that holds our music, for playback. It isn't opened
+     * until you call openMusic() or startPlaying(). We get the duration without it.
+     */
     sf::Music music;
     bool isOpen = false;
 
@@ -204,6 +355,12 @@ public:
     double duration;
     double beatDurationSeconds;
 
+    /** How save() writes the beatmaps. info.dat is always JSON. */
+    BeatmapFormat saveFormat = BeatmapFormat::JSON;
+
+    /** Turn off to keep open() from reporting its progress, as batch runs do. */
+    bool verbose = true;
+
     // Information on what we're currently doing.
     static int currentCutDirection;	// Up
     static int currentNoteType;		// Red
@@ -214,6 +371,7 @@ public:
     int open(const std::string fromLocation);
     void save();
     void close();
+    bool openMusic();
     void startPlaying();
 
     static void setCurrentSong(Song *song) { currentSong = song; }
@@ -222,6 +380,7 @@ public:
     SongDifficulty *	getDifficulty(LevelDifficulty difficulty);
     SongDifficulty *	createDifficulty(LevelDifficulty difficulty);
     SongBeatmapData *	getBeatmap(const std::string & filename);
+    void prefetchBeatmaps();
 
     void setLoadedFrom(const std::string &value) { loadedFrom = value; }
     const std::string &getLoadedFrom() { return loadedFrom; }
@@ -0,0 +1,343 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <showpage/BinaryCodec.h>
+#include <showpage/FileUtilities.h>
+
+#include "SongIndex.h"
+#include "Song.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+namespace BeatPatterns {
+
+/** Bump the version any time the layout below changes. */
+static const char		IndexMagic[8] = { 'B', 'P', 'S', 'O', 'N', 'G', 'I', 'X' };
+static const uint32_t	IndexVersion = 1;
+static const uint32_t	IndexByteOrder = 0x01020304;
+static const uint32_t	IndexEndMarker = 0x454E4421;
+
+/**
+ * Lower case copy, for searching.
+ */
+static string
+lowerCase(const string &value) {
+    string retVal = value;
+    std::transform(retVal.begin(), retVal.end(), retVal.begin(), [](unsigned char ch) { return static_cast<char>(tolower(ch)); });
+    return retVal;
+}
+
+/**
+ * Constructor.
+ */
+SongIndex::SongIndex(const std::string &_libraryPath)
+    : libraryPath(_libraryPath), indexFileName(_libraryPath + "/.BeatPatternsIndex")
+{
+}
+
+/**
+ * Read the index we saved last time. Returns false (with no entries) if there
+ * isn't one or we can't make sense of it.
+ */
+bool
+SongIndex::load() {
+    entries.clear();
+
+    std::ifstream input(indexFileName, std::ios::binary | std::ios::ate);
+    if (!input) {
+        return false;
+    }
+
+    std::streamoff length = input.tellg();
+    string contents(static_cast<size_t>(length), '\0');
+    input.seekg(0);
+    if (!input.read(&contents[0], length)) {
+        return false;
+    }
+
+    BinaryReader reader(contents.data(), contents.size());
+
+    char magic[sizeof(IndexMagic)];
+    for (char &ch: magic) {
+        ch = reader.get<char>();
+    }
+    if (memcmp(magic, IndexMagic, sizeof(IndexMagic)) != 0
+        || reader.get<uint32_t>() != IndexVersion
+        || reader.get<uint32_t>() != IndexByteOrder)
+    {
+        return false;
+    }
+
+    uint32_t count = reader.get<uint32_t>();
+    if (!reader.fits(count, sizeof(uint32_t))) {
+        return false;
+    }
+    entries.resize(count);
+
+    for (Entry &entry: entries) {
+        entry.path = reader.getString();
+        entry.infoModified = reader.get<int64_t>();
+        entry.songName = reader.getString();
+        entry.songSubName = reader.getString();
+        entry.songAuthorName = reader.getString();
+        entry.levelAuthorName = reader.getString();
+        entry.beatsPerMinute = reader.get<int32_t>();
+        entry.songFilename = reader.getString();
+
+        uint32_t difficultyCount = reader.get<uint32_t>();
+        if (!reader.fits(difficultyCount, sizeof(int32_t))) {
+            break;
+        }
+        entry.difficulties.resize(difficultyCount);
+        for (Difficulty &difficulty: entry.difficulties) {
+            difficulty.difficulty = static_cast<LevelDifficulty>(reader.get<int32_t>());
+            difficulty.beatmapFilename = reader.getString();
+            difficulty.modified = reader.get<int64_t>();
+        }
+    }
+
+    if (reader.get<uint32_t>() != IndexEndMarker || !reader.ok || !reader.atEnd()) {
+        entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Write the index, through a temporary file so nobody reads half of it.
+ */
+void
+SongIndex::save() const {
+    BinaryWriter writer;
+
+    writer.bytes.append(IndexMagic, sizeof(IndexMagic));
+    writer.put<uint32_t>(IndexVersion);
+    writer.put<uint32_t>(IndexByteOrder);
+
+    writer.put<uint32_t>(static_cast<uint32_t>(entries.size()));
+    for (const Entry &entry: entries) {
+        writer.putString(entry.path);
+        writer.put<int64_t>(entry.infoModified);
+        writer.putString(entry.songName);
+        writer.putString(entry.songSubName);
+        writer.putString(entry.songAuthorName);
+        writer.putString(entry.levelAuthorName);
+        writer.put<int32_t>(entry.beatsPerMinute);
+        writer.putString(entry.songFilename);
+
+        writer.put<uint32_t>(static_cast<uint32_t>(entry.difficulties.size()));
+        for (const Difficulty &difficulty: entry.difficulties) {
+            writer.put<int32_t>(static_cast<int32_t>(difficulty.difficulty));
+            writer.putString(difficulty.beatmapFilename);
+            writer.put<int64_t>(difficulty.modified);
+        }
+    }
+    writer.put<uint32_t>(IndexEndMarker);
+
+    string tempName = indexFileName + ".tmp";
+    std::ofstream output(tempName, std::ios::binary | std::ios::trunc);
+    output.write(writer.bytes.data(), static_cast<std::streamsize>(writer.bytes.size()));
+    output.close();
+
+    if (!output || std::rename(tempName.c_str(), indexFileName.c_str()) != 0) {
+        cout << "Unable to write song index " << indexFileName << endl;
+        std::remove(tempName.c_str());
+    }
+}
+
+/**
+ * Build the entry for the song in this directory. If we have a previous entry
+ * and info.dat hasn't changed, we keep it and only re-stat the maps.
+ *
+ * Returns 1 if we read info.dat, 0 if we reused the previous entry, or -1 if
+ * this isn't a song we can read.
+ */
+int
+SongIndex::readEntry(const std::string &relativePath, const Entry *previous, Entry &entry) const {
+    string dirName = libraryPath + relativePath;
+    uint64_t size = 0;
+    int64_t infoModified = 0;
+
+    if (!FileUtilities::statFile(dirName + "/info.dat", size, infoModified)) {
+        return -1;
+    }
+
+    int retVal = 0;
+    if (previous != nullptr && previous->infoModified == infoModified) {
+        entry = *previous;
+    }
+    else {
+        SongInfo info;
+        try {
+            info.load(dirName + "/info.dat");
+        }
+        catch (const nlohmann::json::exception &e) {
+            cout << "Skipping " << dirName << ": " << e.what() << endl;
+            return -1;
+        }
+
+        entry.path = relativePath;
+        entry.infoModified = infoModified;
+        entry.songName = info.songName;
+        entry.songSubName = info.songSubName;
+        entry.songAuthorName = info.songAuthorName;
+        entry.levelAuthorName = info.levelAuthorName;
+        entry.beatsPerMinute = info.beatsPerMinute;
+        entry.songFilename = info.songFilename;
+
+        entry.difficulties.clear();
+        for (SongDifficultySet *set: info.getDifficultySets()) {
+            for (SongDifficulty *songDifficulty: set->difficulties) {
+                Difficulty difficulty;
+                difficulty.difficulty = songDifficulty->difficulty;
+                difficulty.beatmapFilename = songDifficulty->beatmapFilename;
+                entry.difficulties.push_back(difficulty);
+            }
+        }
+        retVal = 1;
+    }
+
+    for (Difficulty &difficulty: entry.difficulties) {
+        difficulty.modified = 0;
+        FileUtilities::statFile(dirName + "/" + difficulty.beatmapFilename, size, difficulty.modified);
+    }
+
+    return retVal;
+}
+
+/**
+ * Walk the library and bring the index up to date. Several threads share a list
+ * of directories still to look at. A directory with an info.dat is a song, and we
+ * don't look inside it; any other directory goes back on the list. Anything
+ * beginning with a dot is skipped. Songs we already know about just get a stat.
+ */
+void
+SongIndex::refresh(size_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::map<string, const Entry *> previous;
+    for (const Entry &entry: entries) {
+        previous[entry.path] = &entry;
+    }
+
+    std::vector<Entry> found;
+    std::deque<string> toVisit { string() };
+    size_t busy = 0;
+    size_t readCount = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            changed.wait(lock, [&]() { return !toVisit.empty() || busy == 0; });
+            if (toVisit.empty()) {
+                return;
+            }
+
+            string relativePath = toVisit.front();
+            toVisit.pop_front();
+            ++busy;
+            lock.unlock();
+
+            std::vector<string> subdirs;
+            bool isSong = false;
+            Entry entry;
+            int status = -1;
+
+            // We already know this song, so there's no need to look through its directory.
+            auto pos = previous.find(relativePath);
+            if (pos != previous.end()) {
+                status = readEntry(relativePath, pos->second, entry);
+                isSong = status >= 0;
+            }
+
+            if (!isSong) {
+                boost::system::error_code error;
+                boost::filesystem::directory_iterator end_iter;
+                for ( boost::filesystem::directory_iterator dir_itr( libraryPath + relativePath, error ); !error && dir_itr != end_iter; dir_itr.increment(error) ) {
+                    string name = dir_itr->path().filename().string();
+                    if (name.at(0) == '.') {
+                        continue;
+                    }
+                    if (name == "info.dat") {
+                        isSong = true;
+                    }
+                    else if (boost::filesystem::is_directory(dir_itr->status())) {
+                        subdirs.push_back(relativePath + "/" + name);
+                    }
+                }
+
+                if (isSong) {
+                    status = readEntry(relativePath, nullptr, entry);
+                }
+            }
+
+            lock.lock();
+            if (status >= 0) {
+                found.push_back(std::move(entry));
+                readCount += status;
+            }
+            else if (!isSong) {
+                toVisit.insert(toVisit.end(), subdirs.begin(), subdirs.end());
+            }
+            --busy;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t count = 1; count < threadCount; ++count) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+
+    std::sort(found.begin(), found.end(), [](const Entry &a, const Entry &b) { return a.path < b.path; });
+
+    entries.swap(found);
+    lastReadCount = readCount;
+}
+
+/**
+ * Find songs whose name, sub name, artist, mapper or directory contain this text,
+ * ignoring case. An empty string matches everything.
+ */
+std::vector<const SongIndex::Entry *>
+SongIndex::search(const std::string &text) const {
+    std::vector<const Entry *> retVal;
+    string lookFor = lowerCase(text);
+
+    for (const Entry &entry: entries) {
+        if (lookFor.empty()
+            || lowerCase(entry.songName).find(lookFor) != string::npos
+            || lowerCase(entry.songSubName).find(lookFor) != string::npos
+            || lowerCase(entry.songAuthorName).find(lookFor) != string::npos
+            || lowerCase(entry.levelAuthorName).find(lookFor) != string::npos
+            || lowerCase(entry.path).find(lookFor) != string::npos)
+        {
+            retVal.push_back(&entry);
+        }
+    }
+
+    return retVal;
+}
+
+} // namespace BeatPatterns
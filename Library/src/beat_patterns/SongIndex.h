@@ -0,0 +1,70 @@
+#ifndef SONGINDEX_H
+#define SONGINDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Common.h"
+
+namespace BeatPatterns {
+
+/**
+ * This is an index of every song in the library, kept in <library>/.BeatPatternsIndex
+ * so we can list and search the library without reading every info.dat.
+ *
+ * To use: construct with the library path, load() whatever we saved last time,
+ * refresh() to pick up changes, then save(). Refreshing walks the library with a
+ * few threads, but only re-reads an info.dat if its modification time changed.
+ */
+class SongIndex {
+public:
+    class Difficulty {
+    public:
+        LevelDifficulty	difficulty = LevelDifficulty::Easy;
+        std::string		beatmapFilename;
+        int64_t			modified = 0;		// Nanoseconds; 0 if the file doesn't exist yet.
+    };
+
+    class Entry {
+    public:
+        /** The song's directory, relative to the library. */
+        std::string		path;
+        int64_t			infoModified = 0;
+
+        std::string		songName;
+        std::string		songSubName;
+        std::string		songAuthorName;
+        std::string		levelAuthorName;
+        int				beatsPerMinute = 0;
+        std::string		songFilename;
+
+        std::vector<Difficulty> difficulties;
+    };
+
+private:
+    std::string			libraryPath;
+    std::string			indexFileName;
+    std::vector<Entry>	entries;
+
+    /** How many info.dat files the last refresh had to read. */
+    size_t				lastReadCount = 0;
+
+    int readEntry(const std::string &relativePath, const Entry *previous, Entry &entry) const;
+
+public:
+    SongIndex(const std::string &_libraryPath);
+
+    bool load();
+    void save() const;
+    void refresh(size_t threadCount = 0);
+
+    const std::vector<Entry> & getEntries() const { return entries; }
+    size_t getLastReadCount() const { return lastReadCount; }
+
+    std::vector<const Entry *> search(const std::string &text) const;
+};
+
+} // namespace BeatPatterns
+
+#endif // SONGINDEX_H
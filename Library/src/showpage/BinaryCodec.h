@@ -0,0 +1,76 @@
+#ifndef SRC_LIB_BINARYCODEC_H_
+#define SRC_LIB_BINARYCODEC_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * These two help with our little binary files (caches and indexes). Values are
+ * written in this machine's byte order, so write a known marker near the front
+ * of your file and check it when you read.
+ *
+ * The writer builds the whole image in memory. The reader works over a block of
+ * memory, such as a mapped file. Any read past the end clears ok, after which
+ * every read returns zero, so you can read a whole record and check ok once.
+ */
+class BinaryWriter {
+public:
+    std::string bytes;
+
+    template <class T>
+    void put(T value) {
+        bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    void putString(const std::string &value) {
+        put<uint32_t>(static_cast<uint32_t>(value.size()));
+        bytes.append(value);
+    }
+};
+
+class BinaryReader {
+private:
+    const char *	pos;
+    const char *	end;
+
+public:
+    bool ok = true;
+
+    BinaryReader(const char *data, size_t length): pos(data), end(data + length) {}
+
+    bool atEnd() const { return pos == end; }
+
+    /** Would count records of at least this many bytes each fit in what's left? */
+    bool fits(uint32_t count, size_t eachAtLeast) {
+        if (static_cast<size_t>(end - pos) / eachAtLeast < count) {
+            ok = false;
+        }
+        return ok;
+    }
+
+    template <class T>
+    T get() {
+        T value = T();
+        if (!ok || static_cast<size_t>(end - pos) < sizeof(T)) {
+            ok = false;
+            return value;
+        }
+        memcpy(&value, pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    std::string getString() {
+        uint32_t length = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - pos) < length) {
+            ok = false;
+            return std::string();
+        }
+        std::string value(pos, length);
+        pos += length;
+        return value;
+    }
+};
+
+#endif /* SRC_LIB_BINARYCODEC_H_ */
@@ -0,0 +1,179 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "BlockCompression.h"
+
+using namespace std;
+
+/** The format's rules: matches are at least this long... */
+static const size_t MinMatch = 4;
+
+/** ...the last five bytes are always literals, and no match starts in the last twelve. */
+static const size_t LastLiterals = 5;
+static const size_t MatchFindLimit = 12;
+
+static const size_t MaxOffset = 65535;
+static const int HashBits = 14;
+
+static uint32_t
+read32(const char *pos) {
+    uint32_t value;
+    memcpy(&value, pos, sizeof(value));
+    return value;
+}
+
+static size_t
+hashOf(uint32_t value) {
+    return (value * 2654435761U) >> (32 - HashBits);
+}
+
+/**
+ * A length that didn't fit in its four bits of the token: 255s, then the rest.
+ */
+static void
+putLength(string &output, size_t length) {
+    while (length >= 255) {
+        output.push_back(static_cast<char>(255));
+        length -= 255;
+    }
+    output.push_back(static_cast<char>(length));
+}
+
+/**
+ * One sequence: literals followed by a match. A matchLength of zero means the
+ * final sequence, which is literals only.
+ */
+static void
+putSequence(string &output, const char *literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength > 0 ? matchLength - MinMatch : 0;
+    uint8_t token = static_cast<uint8_t>(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+    output.push_back(static_cast<char>(token));
+    if (literalLength >= 15) {
+        putLength(output, literalLength - 15);
+    }
+    output.append(literals, literalLength);
+
+    if (matchLength > 0) {
+        output.push_back(static_cast<char>(offset & 0xff));
+        output.push_back(static_cast<char>(offset >> 8));
+        if (matchCode >= 15) {
+            putLength(output, matchCode - 15);
+        }
+    }
+}
+
+/**
+ * Compress this block. We look for matches through a hash of the next four bytes,
+ * taking the first one we find.
+ */
+std::string
+BlockCompression::compress(const char *data, size_t length) {
+    string output;
+    output.reserve(length / 2 + 16);
+
+    const char * anchor = data;
+    const char * end = data + length;
+
+    if (length > MatchFindLimit) {
+        // Positions are stored plus one so zero means empty.
+        vector<size_t> table(static_cast<size_t>(1) << HashBits, 0);
+        const char * matchLimit = end - LastLiterals;
+        const char * pos = data;
+
+        while (pos + MatchFindLimit <= end) {
+            uint32_t sequence = read32(pos);
+            size_t & slot = table[hashOf(sequence)];
+            const char * candidate = slot > 0 ? data + (slot - 1) : nullptr;
+            slot = static_cast<size_t>(pos - data) + 1;
+
+            if (candidate == nullptr || static_cast<size_t>(pos - candidate) > MaxOffset || read32(candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+
+            size_t matchLength = MinMatch;
+            while (pos + matchLength < matchLimit && candidate[matchLength] == pos[matchLength]) {
+                ++matchLength;
+            }
+
+            putSequence(output, anchor, static_cast<size_t>(pos - anchor), static_cast<size_t>(pos - candidate), matchLength);
+            pos += matchLength;
+            anchor = pos;
+        }
+    }
+
+    putSequence(output, anchor, static_cast<size_t>(end - anchor), 0, 0);
+    return output;
+}
+
+/**
+ * Decompress a block that should come out to exactly outputLength bytes. Returns
+ * false, having written no further than outputLength, if the block is damaged.
+ */
+bool
+BlockCompression::decompress(const char *data, size_t length, char *output, size_t outputLength) {
+    const uint8_t * in = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t * inEnd = in + length;
+    char * out = output;
+    char * outEnd = output + outputLength;
+
+    // Reads a length continued past its four bits of token. False if we run off the end.
+    auto getLength = [&](size_t &value) {
+        uint8_t byte;
+        do {
+            if (in >= inEnd) {
+                return false;
+            }
+            byte = *in++;
+            value += byte;
+        } while (byte == 255);
+        return true;
+    };
+
+    while (in < inEnd) {
+        uint8_t token = *in++;
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(literalLength)) {
+            return false;
+        }
+        if (static_cast<size_t>(inEnd - in) < literalLength || static_cast<size_t>(outEnd - out) < literalLength) {
+            return false;
+        }
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        // The last sequence has no match.
+        if (in == inEnd) {
+            break;
+        }
+
+        if (inEnd - in < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+
+        size_t matchLength = token & 0x0f;
+        if (matchLength == 15 && !getLength(matchLength)) {
+            return false;
+        }
+        matchLength += MinMatch;
+
+        if (offset == 0 || offset > static_cast<size_t>(out - output) || static_cast<size_t>(outEnd - out) < matchLength) {
+            return false;
+        }
+
+        // The match may overlap what we're writing, so copy a byte at a time.
+        const char * from = out - offset;
+        for (size_t index = 0; index < matchLength; ++index) {
+            out[index] = from[index];
+        }
+        out += matchLength;
+    }
+
+    return out == outEnd;
+}
@@ -0,0 +1,22 @@
+#ifndef SRC_LIB_BLOCKCOMPRESSION_H_
+#define SRC_LIB_BLOCKCOMPRESSION_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A small, fast LZ77 compressor for the blocks inside our binary files. The output
+ * is the LZ4 block format: a run of sequences, each a token byte, some literals,
+ * and a two-byte offset back to a match of at least four bytes. We trade ratio for
+ * speed; decompression is a tight copy loop.
+ *
+ * There's no header. Store the uncompressed length beside the block, since
+ * decompress() needs it.
+ */
+class BlockCompression {
+public:
+    static std::string compress(const char *data, size_t length);
+    static bool decompress(const char *data, size_t length, char *output, size_t outputLength);
+};
+
+#endif /* SRC_LIB_BLOCKCOMPRESSION_H_ */
@@ -37,6 +37,26 @@ isDirectory(const string &filename) {
     return (rv == 0) && S_ISDIR(statBuf.st_mode);
 }
 
+/**
+ * Get the size and modification time (in nanoseconds since the epoch) of this file.
+ * Returns false if we can't stat it.
+ */
+bool
+statFile(const string &filename, uint64_t &size, int64_t &modifiedNanos) {
+    struct stat statBuf;
+    if (stat(filename.c_str(), &statBuf) != 0) {
+        return false;
+    }
+
+    size = static_cast<uint64_t>(statBuf.st_size);
+#ifdef __APPLE__
+    modifiedNanos = static_cast<int64_t>(statBuf.st_mtimespec.tv_sec) * 1000000000LL + statBuf.st_mtimespec.tv_nsec;
+#else
+    modifiedNanos = static_cast<int64_t>(statBuf.st_mtim.tv_sec) * 1000000000LL + statBuf.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
 void
 makeDirectoryPath(const std::string &dirName) {
     if (exists(dirName.c_str())) {
@@ -2,11 +2,13 @@
 #define SRC_LIB_FILEUTILITIES_H_
 
 #include <string>
+#include <cstdint>
 
 namespace FileUtilities {
 	std::string readFile(const std::string &filename);
     bool exists(const std::string &filename);
     bool isDirectory(const std::string &filename);
+    bool statFile(const std::string &filename, uint64_t &size, int64_t &modifiedNanos);
 
     void makeDirectoryPath(const std::string &path);
 }
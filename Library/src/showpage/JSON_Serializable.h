@@ -63,7 +63,7 @@ public:
      */
     void fromJSON(const nlohmann::json & array) {
         for (auto iter = array.begin(); iter != array.end(); ++iter) {
-            nlohmann::json obj = *iter;
+            const nlohmann::json & obj = *iter;
 
             ObjectType thisDiff;
             thisDiff.fromJSON(obj);
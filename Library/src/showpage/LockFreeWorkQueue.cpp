@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <cstdint>
+
+#include "LockFreeWorkQueue.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Round the capacity up to a power of two so we can mask instead of divide.
+ */
+static size_t
+ringSize(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    return size;
+}
+
+/**
+ * Constructor.
+ */
+LockFreeWorkQueue_Base::LockFreeWorkQueue_Base(size_t capacity)
+    : slots(ringSize(capacity)),
+      mask(slots.size() - 1),
+      tail(0),
+      frontStack(nullptr),
+      count(0),
+      running(true),
+      overflowing(false),
+      consumerWaiting(false)
+{
+    for (size_t index = 0; index < slots.size(); ++index) {
+        slots[index].sequence.store(index, memory_order_relaxed);
+    }
+}
+
+/**
+ * Destructor. The ring, heap and lists clean up after themselves; the front stack doesn't.
+ */
+LockFreeWorkQueue_Base::~LockFreeWorkQueue_Base() {
+    FrontNode * node = frontStack.exchange(nullptr);
+    while (node != nullptr) {
+        FrontNode * next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+/**
+ * Put this in the ring. Returns false if the ring is full, in which case we
+ * haven't touched the entry.
+ *
+ * Each slot's sequence is its position when it's free for a producer, and its
+ * position + 1 once it holds an entry for the consumer. Producers race for the
+ * tail with a compare-and-swap, and the winner fills the slot and then
+ * publishes it by bumping the sequence.
+ */
+bool
+LockFreeWorkQueue_Base::push(WorkQueue_Entry::Ptr &entry) {
+    size_t pos = tail.load(memory_order_relaxed);
+
+    while (true) {
+        Slot & slot = slots[pos & mask];
+        size_t sequence = slot.sequence.load(memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+        if (difference == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                slot.entry = std::move(entry);
+                slot.sequence.store(pos + 1, memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            // The consumer hasn't emptied this slot from last time around.
+            return false;
+        }
+        else {
+            pos = tail.load(memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Take the oldest entry out of the ring. Consumer only.
+ */
+bool
+LockFreeWorkQueue_Base::pop(WorkQueue_Entry::Ptr &entry) {
+    Slot & slot = slots[head & mask];
+    if (slot.sequence.load(memory_order_acquire) != head + 1) {
+        return false;
+    }
+
+    entry = std::move(slot.entry);
+    slot.entry.reset();
+    slot.sequence.store(head + mask + 1, memory_order_release);
+    ++head;
+
+    return true;
+}
+
+/**
+ * Wake the consumer if it's asleep. The fence pairs with the one in
+ * baseGetMoreWork(), so either we see it waiting or it sees our entry.
+ */
+void
+LockFreeWorkQueue_Base::wake() {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (consumerWaiting.load(memory_order_relaxed)) {
+        std::unique_lock<std::mutex> mlock(mutex);
+        condVar.notify_one();
+    }
+}
+
+/**
+ * The worker for the add methods. The caller has already counted the entry.
+ * Once we've overflowed, everyone goes to the overflow list until the consumer
+ * empties it, so entries still come out in order.
+ */
+void
+LockFreeWorkQueue_Base::_add(WorkQueue_Entry::Ptr entry) {
+    if (overflowing.load(memory_order_acquire) || !push(entry)) {
+        std::unique_lock<std::mutex> mlock(overflowMutex);
+        overflow.push_back(std::move(entry));
+        overflowing.store(true, memory_order_release);
+    }
+    wake();
+}
+
+/**
+ * Add to our queue.
+ */
+void
+LockFreeWorkQueue_Base::baseAdd(WorkQueue_Entry::Ptr entry) {
+    count.fetch_add(1, memory_order_relaxed);
+    _add(std::move(entry));
+}
+
+/**
+ * A convenience method for setting the fired at.
+ */
+void
+LockFreeWorkQueue_Base::baseAdd(WorkQueue_Entry::Ptr entry, const long millisecondDelay) {
+    entry->fireAt = system_clock::now() + milliseconds(millisecondDelay);
+    baseAdd(std::move(entry));
+}
+
+/**
+ * Add to the queue only if the queue is empty. If several threads try at once, one wins.
+ */
+void
+LockFreeWorkQueue_Base::baseAddIfEmpty(WorkQueue_Entry::Ptr entry) {
+    size_t expected = 0;
+    if (count.compare_exchange_strong(expected, 1)) {
+        _add(std::move(entry));
+    }
+}
+
+/**
+ * Add to the queue only if the queue is empty.
+ */
+void
+LockFreeWorkQueue_Base::baseAddIfEmpty(WorkQueue_Entry::Ptr entry, const long millisecondDelay) {
+    entry->fireAt = system_clock::now() + milliseconds(millisecondDelay);
+    baseAddIfEmpty(std::move(entry));
+}
+
+/**
+ * Add to the very front of the queue.
+ */
+void
+LockFreeWorkQueue_Base::baseAddFront(WorkQueue_Entry::Ptr entry) {
+    count.fetch_add(1, memory_order_relaxed);
+
+    FrontNode * node = new FrontNode();
+    node->entry = std::move(entry);
+    node->next = frontStack.load(memory_order_relaxed);
+    while (!frontStack.compare_exchange_weak(node->next, node, memory_order_release, memory_order_relaxed)) {
+    }
+
+    wake();
+}
+
+/**
+ * Signal we should shut down.
+ */
+void
+LockFreeWorkQueue_Base::shutdown() {
+    running = false;
+    std::unique_lock<std::mutex> mlock(mutex);
+    condVar.notify_all();
+}
+
+/**
+ * Signal a reset in running (turn it back on).
+ */
+void
+LockFreeWorkQueue_Base::reset() {
+    running = true;
+    std::unique_lock<std::mutex> mlock(mutex);
+    condVar.notify_all();
+}
+
+/**
+ * Is there anything a producer might have given us since we last looked?
+ */
+bool
+LockFreeWorkQueue_Base::mightHaveWork() {
+    return frontStack.load(memory_order_acquire) != nullptr
+        || slots[head & mask].sequence.load(memory_order_acquire) == head + 1
+        || overflowing.load(memory_order_acquire);
+}
+
+/**
+ * Find the next entry that's ready to fire, moving anything that isn't due yet
+ * into the heap. Returns null if nothing is ready. Consumer only.
+ */
+WorkQueue_Entry::Ptr
+LockFreeWorkQueue_Base::takeReady(system_clock::time_point now) {
+    // Anything added to the front. The stack is newest first, which is also the
+    // order they go in front of the ones we picked up last time.
+    FrontNode * node = frontStack.exchange(nullptr, memory_order_acquire);
+    if (node != nullptr) {
+        std::deque<WorkQueue_Entry::Ptr> newer;
+        while (node != nullptr) {
+            FrontNode * next = node->next;
+            newer.push_back(std::move(node->entry));
+            delete node;
+            node = next;
+        }
+        front.insert(front.begin(), newer.begin(), newer.end());
+    }
+
+    while (!front.empty()) {
+        WorkQueue_Entry::Ptr entry = std::move(front.front());
+        front.pop_front();
+        if (entry->fireAt <= now) {
+            return entry;
+        }
+        timed.push_back(Timed { std::move(entry), timedOrder++ });
+        std::push_heap(timed.begin(), timed.end());
+    }
+
+    // Then the ring, followed by anything that spilled over.
+    WorkQueue_Entry::Ptr entry;
+    bool found = false;
+    while (!found && pop(entry)) {
+        found = entry->fireAt <= now;
+        if (!found) {
+            timed.push_back(Timed { std::move(entry), timedOrder++ });
+            std::push_heap(timed.begin(), timed.end());
+        }
+    }
+
+    if (!found && overflowing.load(memory_order_acquire)) {
+        std::unique_lock<std::mutex> mlock(overflowMutex);
+        while (!found && !overflow.empty()) {
+            entry = std::move(overflow.front());
+            overflow.pop_front();
+            found = entry->fireAt <= now;
+            if (!found) {
+                timed.push_back(Timed { std::move(entry), timedOrder++ });
+                std::push_heap(timed.begin(), timed.end());
+            }
+        }
+        if (overflow.empty()) {
+            overflowing.store(false, memory_order_release);
+        }
+    }
+
+    // If something in the heap came due earlier, it goes first.
+    if (!timed.empty() && timed.front().entry->fireAt <= now && (!found || timed.front().entry->fireAt < entry->fireAt)) {
+        if (found) {
+            timed.push_back(Timed { std::move(entry), timedOrder++ });
+            std::push_heap(timed.begin(), timed.end());
+        }
+        std::pop_heap(timed.begin(), timed.end());
+        entry = std::move(timed.back().entry);
+        timed.pop_back();
+        found = true;
+    }
+
+    return found ? entry : nullptr;
+}
+
+/**
+ * Get the next one, blocking until either it's ready or we're shut down.
+ */
+WorkQueue_Entry::Ptr
+LockFreeWorkQueue_Base::baseGetMoreWork() {
+    WorkQueue_Entry::Ptr retVal ( nullptr );
+    milliseconds longTime(3600000);	// one hour
+
+    while (running && retVal == nullptr) {
+        retVal = baseGetMoreWork(longTime);
+    }
+    return retVal;
+}
+
+/**
+ * Get the next entry that's ready, blocking until something is or we've expired
+ * our duration. Only one thread may call this.
+ */
+WorkQueue_Entry::Ptr
+LockFreeWorkQueue_Base::baseGetMoreWork(std::chrono::milliseconds duration) {
+    system_clock::time_point waitUntil = system_clock::now() + duration;
+
+    while (running) {
+        system_clock::time_point now = system_clock::now();
+
+        WorkQueue_Entry::Ptr retVal = takeReady(now);
+        if (retVal != nullptr) {
+            count.fetch_sub(1, memory_order_relaxed);
+            return retVal;
+        }
+        if (now > waitUntil) {
+            return nullptr;
+        }
+
+        system_clock::time_point thisWait = waitUntil;
+        if (!timed.empty() && timed.front().entry->fireAt < thisWait) {
+            thisWait = timed.front().entry->fireAt;
+        }
+
+        // Say we're going to sleep, then look once more, so a producer either
+        // sees us waiting or we see its entry.
+        std::unique_lock<std::mutex> mlock(mutex);
+        consumerWaiting.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (running && !mightHaveWork()) {
+            condVar.wait_until(mlock, thisWait);
+        }
+        consumerWaiting.store(false, memory_order_relaxed);
+    }
+
+    return nullptr;
+}
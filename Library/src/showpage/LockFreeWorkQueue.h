@@ -0,0 +1,117 @@
+#ifndef SRC_LIB_LOCKFREEWORKQUEUE_H_
+#define SRC_LIB_LOCKFREEWORKQUEUE_H_
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "WorkQueue.h"
+
+/**
+ * This is a drop-in alternative to WorkQueue_Base for the case of many threads
+ * adding work and one thread taking it out. Use it through WorkQueue_Template:
+ *
+ * 		WorkQueue_Template<MyEntry, LockFreeWorkQueue_Base> queue;
+ *
+ * Adding work never takes a lock. Entries go into a fixed-size ring, and the
+ * consumer sorts them out: anything not due yet moves to a heap ordered by
+ * fireAt, which only the consumer touches. addFront() uses a separate lock-free
+ * stack, so those still come out first, newest first, as with WorkQueue_Base.
+ *
+ * If the ring fills, we spill into a locked overflow list until the consumer
+ * catches up. That's the only lock producers ever take, apart from waking a
+ * consumer that's asleep.
+ *
+ * Differences from WorkQueue_Base: only ONE thread may call getMoreWork(), and
+ * there are no iterators, remove() or listQueue(), as we can't walk the ring
+ * while producers are writing into it.
+ */
+class LockFreeWorkQueue_Base {
+private:
+    /** One slot in the ring. sequence says whose turn it is (see add()). */
+    class Slot {
+    public:
+        std::atomic<size_t>		sequence;
+        WorkQueue_Entry::Ptr	entry;
+    };
+
+    /** A node in the addFront() stack. */
+    class FrontNode {
+    public:
+        WorkQueue_Entry::Ptr	entry;
+        FrontNode *				next = nullptr;
+    };
+
+    /** An entry waiting for its fireAt. order keeps equal times first-in, first-out. */
+    class Timed {
+    public:
+        WorkQueue_Entry::Ptr	entry;
+        uint64_t				order;
+
+        bool operator<(const Timed &other) const {
+            return entry->fireAt > other.entry->fireAt || (entry->fireAt == other.entry->fireAt && order > other.order);
+        }
+    };
+
+    std::vector<Slot>			slots;
+    size_t						mask;
+
+    /** Producers claim slots here. Kept apart from the consumer's end so they don't share a cache line. */
+    alignas(64) std::atomic<size_t>	tail;
+
+    /** The consumer reads from here. Only the consumer touches it. */
+    alignas(64) size_t			head = 0;
+
+    std::atomic<FrontNode *>	frontStack;
+    std::atomic<size_t>			count;
+    std::atomic<bool>			running;
+
+    // Everything from here on belongs to the consumer, apart from the overflow.
+    std::deque<WorkQueue_Entry::Ptr>	front;
+    std::vector<Timed>			timed;
+    uint64_t					timedOrder = 0;
+
+    std::mutex					overflowMutex;
+    std::deque<WorkQueue_Entry::Ptr>	overflow;
+    std::atomic<bool>			overflowing;
+
+    // For sleeping when there's nothing to do.
+    std::mutex					mutex;
+    std::condition_variable		condVar;
+    std::atomic<bool>			consumerWaiting;
+
+    bool push(WorkQueue_Entry::Ptr &entry);
+    bool pop(WorkQueue_Entry::Ptr &entry);
+    void wake();
+
+    void _add(WorkQueue_Entry::Ptr entry);
+    WorkQueue_Entry::Ptr takeReady(std::chrono::system_clock::time_point now);
+    bool mightHaveWork();
+
+public:
+    LockFreeWorkQueue_Base(size_t capacity = 4096);
+    virtual ~LockFreeWorkQueue_Base();
+
+    void baseAdd(WorkQueue_Entry::Ptr);
+    void baseAddFront(WorkQueue_Entry::Ptr);
+    void baseAdd(WorkQueue_Entry::Ptr, const long millisecondDelay);
+
+    void baseAddIfEmpty(WorkQueue_Entry::Ptr);
+    void baseAddIfEmpty(WorkQueue_Entry::Ptr, const long millisecondDelay);
+
+    void shutdown();
+    void reset();
+
+    WorkQueue_Entry::Ptr baseGetMoreWork();
+    WorkQueue_Entry::Ptr baseGetMoreWork(std::chrono::milliseconds duration);
+
+    /** Are we marked to contiue running? */
+    bool isRunning() { return running; }
+
+    /** How many entries are queued, including ones not due yet. Only a snapshot. */
+    size_t size() const { return count; }
+};
+
+typedef WorkQueue_Template<WorkQueue_Entry, LockFreeWorkQueue_Base> LockFreeWorkQueue;
+
+#endif /* SRC_LIB_LOCKFREEWORKQUEUE_H_ */
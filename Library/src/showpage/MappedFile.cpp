@@ -0,0 +1,85 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+
+/**
+ * Destructor.
+ */
+MappedFile::~MappedFile() {
+    close();
+}
+
+/**
+ * Open this file, mapping it if it's big enough to be worth it. Returns false if
+ * we can't read it, in which case we're empty.
+ */
+bool
+MappedFile::open(const std::string &fileName) {
+    close();
+
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t fileLength = static_cast<size_t>(info.st_size);
+
+    if (fileLength >= MapThreshold) {
+        void * region = mmap(nullptr, fileLength, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (region != MAP_FAILED) {
+            madvise(region, fileLength, MADV_SEQUENTIAL);
+            ::close(fd);
+
+            contents = static_cast<const char *>(region);
+            length = fileLength;
+            mapped = true;
+            return true;
+        }
+    }
+
+    // Small, or the mapping failed. Read it the usual way.
+    buffer.resize(fileLength);
+    size_t got = 0;
+    while (got < fileLength) {
+        ssize_t count = read(fd, &buffer[got], fileLength - got);
+        if (count <= 0) {
+            break;
+        }
+        got += static_cast<size_t>(count);
+    }
+    ::close(fd);
+
+    if (got < fileLength) {
+        buffer.clear();
+        return false;
+    }
+
+    contents = buffer.data();
+    length = buffer.size();
+    return true;
+}
+
+/**
+ * Let go of the contents.
+ */
+void
+MappedFile::close() {
+    if (mapped) {
+        munmap(const_cast<char *>(contents), length);
+    }
+
+    contents = "";
+    length = 0;
+    mapped = false;
+    buffer.clear();
+    buffer.shrink_to_fit();
+}
@@ -0,0 +1,48 @@
+#ifndef SRC_LIB_MAPPEDFILE_H_
+#define SRC_LIB_MAPPEDFILE_H_
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A file's contents, read-only, for parsing in place. Large files are mapped into
+ * memory and marked for sequential reading, so the parser reads the page cache
+ * directly rather than a copy of it. Small files aren't worth a mapping, so we
+ * read those into a buffer.
+ *
+ * To use:
+ *
+ * 		MappedFile file;
+ * 		if (file.open(fileName)) {
+ * 			parse(file.data(), file.size());
+ * 		}
+ *
+ * The data is good until close() or we're destroyed.
+ */
+class MappedFile {
+public:
+    /** Files smaller than this are read instead of mapped. */
+    static const size_t MapThreshold = 64 * 1024;
+
+private:
+    const char *	contents = "";
+    size_t			length = 0;
+    bool			mapped = false;
+    std::string		buffer;
+
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &fileName);
+    void close();
+
+    const char * data() const { return contents; }
+    size_t size() const { return length; }
+    bool isMapped() const { return mapped; }
+};
+
+#endif /* SRC_LIB_MAPPEDFILE_H_ */
@@ -20,7 +20,7 @@ public:
 
     /** Do we have this key? */
 	bool contains(const KeyType & key) const {
-		typename std::map<KeyType, ObjectType *>::const_iterator findValue = find(key);
+		typename std::map<KeyType, ObjectType *>::const_iterator findValue = this->find(key);
 		return findValue != this->cend();
 	}
 
@@ -137,7 +137,7 @@ public:
 
     void fromJSON(const nlohmann::json & array) {
         for (auto iter = array.begin(); iter != array.end(); ++iter) {
-            nlohmann::json obj = *iter;
+            const nlohmann::json & obj = *iter;
 
             ObjectType * thisDiff = new ObjectType();
             thisDiff->fromJSON(obj);
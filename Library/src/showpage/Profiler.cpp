@@ -0,0 +1,133 @@
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "Profiler.h"
+
+using namespace std;
+using namespace std::chrono;
+
+std::atomic<bool> Profiler::enabled(false);
+
+namespace {
+
+/** What we've recorded for one timer name. */
+class Timing {
+public:
+    uint64_t			calls = 0;
+    steady_clock::duration	total = steady_clock::duration::zero();
+    steady_clock::duration	longest = steady_clock::duration::zero();
+};
+
+/**
+ * Our state lives in functions so it's there for counters made during static
+ * initialization in other files.
+ */
+mutex &
+profilerMutex() {
+    static mutex retVal;
+    return retVal;
+}
+
+map<string, Timing> &
+timings() {
+    static map<string, Timing> retVal;
+    return retVal;
+}
+
+vector<Profiler::Counter *> &
+counters() {
+    static vector<Profiler::Counter *> retVal;
+    return retVal;
+}
+
+double
+toMilliseconds(steady_clock::duration value) {
+    return duration<double, milli>(value).count();
+}
+
+}
+
+/**
+ * Constructor. Counters live for the whole run, so we just remember where they are.
+ */
+Profiler::Counter::Counter(const char *name)
+    : name(name), value(0)
+{
+    unique_lock<mutex> lock(profilerMutex());
+    counters().push_back(this);
+}
+
+/**
+ * Turn profiling on or off. Scopes already open when we turn on aren't recorded.
+ */
+void
+Profiler::setEnabled(bool value) {
+    enabled.store(value, memory_order_relaxed);
+}
+
+/**
+ * A scope has closed.
+ */
+void
+Profiler::record(const char *name, const std::string &detail, steady_clock::duration elapsed) {
+    string key = name;
+    if (!detail.empty()) {
+        key += ".";
+        key += detail;
+    }
+
+    unique_lock<mutex> lock(profilerMutex());
+    Timing & timing = timings()[key];
+
+    ++timing.calls;
+    timing.total += elapsed;
+    if (elapsed > timing.longest) {
+        timing.longest = elapsed;
+    }
+}
+
+/**
+ * Everything so far, as:
+ *
+ * 		{ "timers": { "songOpen": { "calls": 1, "totalMs": 2.5, "maxMs": 2.5 }, ... },
+ * 		  "counters": { "notesEmitted": 1234, ... } }
+ */
+nlohmann::json
+Profiler::toJSON() {
+    nlohmann::json retVal;
+    nlohmann::json timers = nlohmann::json::object();
+    nlohmann::json counts = nlohmann::json::object();
+
+    unique_lock<mutex> lock(profilerMutex());
+
+    for (const auto &pair: timings()) {
+        nlohmann::json timer;
+        timer["calls"] = pair.second.calls;
+        timer["totalMs"] = toMilliseconds(pair.second.total);
+        timer["maxMs"] = toMilliseconds(pair.second.longest);
+        timers[pair.first] = timer;
+    }
+
+    for (const Counter *counter: counters()) {
+        counts[counter->name] = counter->value.load(memory_order_relaxed);
+    }
+
+    retVal["timers"] = timers;
+    retVal["counters"] = counts;
+
+    return retVal;
+}
+
+/**
+ * Forget what we've recorded.
+ */
+void
+Profiler::reset() {
+    unique_lock<mutex> lock(profilerMutex());
+
+    timings().clear();
+    for (Counter *counter: counters()) {
+        counter->value.store(0, memory_order_relaxed);
+    }
+}
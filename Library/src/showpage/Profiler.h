@@ -0,0 +1,114 @@
+#ifndef SRC_LIB_PROFILER_H_
+#define SRC_LIB_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <json.hpp>
+
+/**
+ * Scoped timers and counters for finding out where a run spends its time.
+ * Everything is off until someone calls Profiler::setEnabled(true). While off, a
+ * Scope or count() costs one relaxed load of a flag, so these can stay in the hot
+ * paths for good.
+ *
+ * To time a phase:
+ *
+ * 		{
+ * 			Profiler::Scope scope("songOpen");
+ * 			...
+ * 		}
+ *
+ * Scopes with the same name add up, so generate run over ten songs reports the
+ * total and the longest. Give a detail to split a phase up: Scope("generate", "Hard")
+ * records as "generate.Hard".
+ *
+ * To count things, make a Counter at file scope and bump it:
+ *
+ * 		static Profiler::Counter notesEmitted("notesEmitted");
+ * 		Profiler::count(notesEmitted, notes.size());
+ *
+ * toJSON() gives you everything recorded so far. It's all thread-safe.
+ */
+class Profiler {
+public:
+    class Counter {
+    public:
+        const char *			name;
+        std::atomic<uint64_t>	value;
+
+        Counter(const char *name);
+    };
+
+    class Scope {
+    private:
+        const char *	name;
+        std::string		detail;
+        bool			active;
+        std::chrono::steady_clock::time_point	start;
+
+    public:
+        Scope(const char *name);
+        Scope(const char *name, const std::string &detail);
+        ~Scope();
+
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+    };
+
+private:
+    static std::atomic<bool>	enabled;
+
+    static void record(const char *name, const std::string &detail, std::chrono::steady_clock::duration elapsed);
+
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool value);
+
+    static void count(Counter &counter, uint64_t by = 1) {
+        if (isEnabled()) {
+            counter.value.fetch_add(by, std::memory_order_relaxed);
+        }
+    }
+
+    static nlohmann::json toJSON();
+    static void reset();
+};
+
+/**
+ * Constructor. Starts the clock if we're profiling.
+ */
+inline
+Profiler::Scope::Scope(const char *name)
+    : name(name), active(Profiler::isEnabled())
+{
+    if (active) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+/**
+ * Constructor. We only keep the detail if we're profiling.
+ */
+inline
+Profiler::Scope::Scope(const char *name, const std::string &detailIn)
+    : name(name), active(Profiler::isEnabled())
+{
+    if (active) {
+        detail = detailIn;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+/**
+ * Destructor. Records how long we were open.
+ */
+inline
+Profiler::Scope::~Scope() {
+    if (active) {
+        Profiler::record(name, detail, std::chrono::steady_clock::now() - start);
+    }
+}
+
+#endif /* SRC_LIB_PROFILER_H_ */
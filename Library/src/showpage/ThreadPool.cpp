@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <exception>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+size_t ThreadPool::sharedThreadCount = 0;
+
+/** Which pool (if any) this thread works for, and which worker it is. */
+static thread_local ThreadPool *	myPool = nullptr;
+static thread_local size_t			myWorkerIndex = 0;
+
+/**
+ * Constructor. Zero threads means one per core.
+ */
+ThreadPool::ThreadPool(size_t threadCount)
+    : pending(0), nextWorker(0)
+{
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t index = 0; index < threadCount; ++index) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    }
+    for (size_t index = 0; index < threadCount; ++index) {
+        threads.push_back(std::thread([this, index]() { run(index); }));
+    }
+}
+
+/**
+ * Destructor. We finish whatever is queued, then stop.
+ */
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread &thread: threads) {
+        thread.join();
+    }
+}
+
+/**
+ * The pool everyone shares. It's created the first time you ask for it.
+ */
+ThreadPool &
+ThreadPool::shared() {
+    static ThreadPool pool(sharedThreadCount);
+    return pool;
+}
+
+/**
+ * How many threads the shared pool should have. This only matters if you call it
+ * before anyone uses the pool. Zero (the default) means one per core.
+ */
+void
+ThreadPool::setSharedThreadCount(size_t threadCount) {
+    sharedThreadCount = threadCount;
+}
+
+/**
+ * If this thread is one of our workers, which one? Otherwise -1.
+ */
+int
+ThreadPool::currentWorker() const {
+    return myPool == this ? static_cast<int>(myWorkerIndex) : -1;
+}
+
+/**
+ * Queue a task. From one of our workers, it goes on that worker's deque; from
+ * anywhere else, we deal it out in turn.
+ *
+ * We count it before it's on a deque. Otherwise a thief could take it and count
+ * it off first, wrapping pending around, and every idle worker would spin.
+ */
+void
+ThreadPool::post(Task task) {
+    int self = currentWorker();
+    size_t index = self >= 0 ? static_cast<size_t>(self) : nextWorker++ % workers.size();
+
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        ++pending;
+    }
+
+    {
+        Worker & worker = *workers[index];
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+    }
+    wakeUp.notify_one();
+}
+
+/**
+ * Find something to do: our own newest task if we have one, otherwise the
+ * oldest task from the next worker that has any.
+ */
+bool
+ThreadPool::takeTask(size_t preferred, Task &task) {
+    {
+        Worker & worker = *workers[preferred];
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            --pending;
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+        Worker & victim = *workers[(preferred + offset) % workers.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            --pending;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Each worker thread runs this until we're destroyed and there's nothing left to do.
+ */
+void
+ThreadPool::run(size_t index) {
+    myPool = this;
+    myWorkerIndex = index;
+
+    while (true) {
+        Task task;
+        if (takeTask(index, task)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping && pending == 0) {
+            return;
+        }
+        wakeUp.wait(lock, [this]() { return stopping || pending > 0; });
+    }
+}
+
+/**
+ * Call body(index) for every index from begin up to (not including) end, spread
+ * across the pool, and return when they're all done. Indexes are handed out in
+ * chunks of grainSize; zero picks a size that gives each thread a few chunks.
+ *
+ * If body throws, the remaining chunks still run, and we rethrow the first
+ * exception once they're done.
+ */
+void
+ThreadPool::parallel_for(size_t begin, size_t end, const std::function<void(size_t)> &body, size_t grainSize) {
+    if (end <= begin) {
+        return;
+    }
+
+    size_t count = end - begin;
+    if (grainSize == 0) {
+        grainSize = std::max(static_cast<size_t>(1), count / (workers.size() * 4));
+    }
+    size_t chunkCount = (count + grainSize - 1) / grainSize;
+
+    class Loop {
+    public:
+        std::atomic<size_t>		nextChunk;
+        std::atomic<size_t>		doneChunks;
+        std::mutex				mutex;
+        std::condition_variable	done;
+        std::exception_ptr		error;
+
+        Loop(): nextChunk(0), doneChunks(0) {}
+    };
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+
+    // Helpers that start after every chunk is taken return without touching
+    // body, so it's fine for them to outlive this call.
+    auto runChunks = [loop, begin, end, grainSize, chunkCount, &body]() {
+        for (size_t chunk = loop->nextChunk++; chunk < chunkCount; chunk = loop->nextChunk++) {
+            size_t from = begin + chunk * grainSize;
+            size_t to = std::min(end, from + grainSize);
+
+            try {
+                for (size_t index = from; index < to; ++index) {
+                    body(index);
+                }
+            }
+            catch (...) {
+                std::unique_lock<std::mutex> lock(loop->mutex);
+                if (!loop->error) {
+                    loop->error = std::current_exception();
+                }
+            }
+
+            if (++loop->doneChunks == chunkCount) {
+                std::unique_lock<std::mutex> lock(loop->mutex);
+                loop->done.notify_all();
+            }
+        }
+    };
+
+    int self = currentWorker();
+    size_t helpers = std::min(chunkCount, workers.size());
+    if (self >= 0) {
+        // We're a worker ourself, and we'll take a share.
+        --helpers;
+    }
+    for (size_t index = 0; index < helpers; ++index) {
+        post(runChunks);
+    }
+
+    if (self >= 0) {
+        runChunks();
+
+        // While the last chunks finish elsewhere, make ourself useful.
+        while (loop->doneChunks < chunkCount) {
+            Task task;
+            if (takeTask(static_cast<size_t>(self), task)) {
+                task();
+            }
+            else {
+                std::unique_lock<std::mutex> lock(loop->mutex);
+                loop->done.wait_for(lock, std::chrono::milliseconds(1), [&]() { return loop->doneChunks == chunkCount; });
+            }
+        }
+    }
+    else {
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->done.wait(lock, [&]() { return loop->doneChunks == chunkCount; });
+    }
+
+    if (loop->error) {
+        std::rethrow_exception(loop->error);
+    }
+}
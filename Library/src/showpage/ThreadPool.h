@@ -0,0 +1,90 @@
+#ifndef SRC_LIB_THREADPOOL_H_
+#define SRC_LIB_THREADPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads for running work in parallel. Each worker has its
+ * own deque of tasks. A worker takes its newest task first, and when it runs out
+ * it steals the oldest task from somebody else. Work submitted from outside the
+ * pool is dealt out to the workers in turn; work submitted from inside a task goes
+ * on that worker's own deque.
+ *
+ * To use:
+ *
+ * 		std::future<int> answer = ThreadPool::shared().submit([]() { return 42; });
+ *
+ * 		ThreadPool::shared().parallel_for(0, items.size(), [&](size_t index) { process(items[index]); });
+ *
+ * Tasks may submit more work or call parallel_for themselves. When a worker has to
+ * wait for its own parallel_for, it runs other tasks in the meantime, so nested
+ * loops don't deadlock.
+ *
+ * Destroying the pool finishes everything already queued.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+private:
+    class Worker {
+    public:
+        std::mutex			mutex;
+        std::deque<Task>	tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>>	workers;
+    std::vector<std::thread>				threads;
+
+    /** Queued but not yet started, across all workers. Only raised with sleepMutex held. */
+    std::atomic<size_t>		pending;
+    std::atomic<size_t>		nextWorker;
+    bool					stopping = false;
+
+    std::mutex				sleepMutex;
+    std::condition_variable	wakeUp;
+
+    static size_t			sharedThreadCount;
+
+    void post(Task task);
+    bool takeTask(size_t preferred, Task &task);
+    void run(size_t index);
+    int currentWorker() const;
+
+public:
+    ThreadPool(size_t threadCount = 0);
+    virtual ~ThreadPool();
+
+    static ThreadPool & shared();
+    static void setSharedThreadCount(size_t threadCount);
+
+    /** How many worker threads we have. */
+    size_t size() const { return threads.size(); }
+
+    /**
+     * Run this function on one of our threads. The future gives you its result, or
+     * rethrows what it threw.
+     */
+    template <class Function>
+    auto submit(Function function) -> std::future<decltype(function())> {
+        typedef decltype(function()) Result;
+
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+        std::future<Result> retVal = task->get_future();
+
+        post([task]() { (*task)(); });
+        return retVal;
+    }
+
+    void parallel_for(size_t begin, size_t end, const std::function<void(size_t)> &body, size_t grainSize = 0);
+};
+
+#endif /* SRC_LIB_THREADPOOL_H_ */
@@ -0,0 +1,179 @@
+#include "TimingWheel.h"
+
+/**
+ * Destructor.
+ */
+TimingWheel::~TimingWheel() {
+    for (auto &pair: timers) {
+        delete pair.second;
+    }
+}
+
+/**
+ * Put this timer in the right slot for how far off it is. Anything already due
+ * goes in the slot for the current tick; advance() fires that slot after it
+ * cascades into it.
+ */
+void
+TimingWheel::place(Timer *timer) {
+    uint64_t delta = timer->expires > currentTick ? timer->expires - currentTick : 0;
+    uint64_t expires = timer->expires > currentTick ? timer->expires : currentTick;
+
+    int level = 0;
+    while (level < Levels - 1 && delta >= (static_cast<uint64_t>(1) << (LevelBits * (level + 1)))) {
+        ++level;
+    }
+
+    // Too far out for even the top wheel, so park it in the top wheel's last slot
+    // before this one. We'll place it again when we get there.
+    if (delta >= (static_cast<uint64_t>(1) << (LevelBits * Levels))) {
+        expires = currentTick + (static_cast<uint64_t>(SlotsPerLevel - 1) << (LevelBits * (Levels - 1)));
+    }
+
+    timer->level = level;
+    timer->slot = static_cast<size_t>(expires >> (LevelBits * level)) & (SlotsPerLevel - 1);
+    timer->previous = nullptr;
+    timer->next = slots[level][timer->slot];
+    if (timer->next != nullptr) {
+        timer->next->previous = timer;
+    }
+    slots[level][timer->slot] = timer;
+}
+
+/**
+ * Take this timer out of its slot.
+ */
+void
+TimingWheel::unlink(Timer *timer) {
+    if (timer->previous != nullptr) {
+        timer->previous->next = timer->next;
+    }
+    else {
+        slots[timer->level][timer->slot] = timer->next;
+    }
+    if (timer->next != nullptr) {
+        timer->next->previous = timer->previous;
+    }
+    timer->previous = nullptr;
+    timer->next = nullptr;
+}
+
+/**
+ * Time has reached this level's current slot, so move what's in it down to finer wheels.
+ */
+void
+TimingWheel::cascade(int level) {
+    size_t slot = static_cast<size_t>(currentTick >> (LevelBits * level)) & (SlotsPerLevel - 1);
+    Timer * timer = slots[level][slot];
+    slots[level][slot] = nullptr;
+
+    while (timer != nullptr) {
+        Timer * next = timer->next;
+        place(timer);
+        timer = next;
+    }
+}
+
+/**
+ * Add an entry to fire at this tick. If that's already past, it fires on the next
+ * advance(). Returns an id you can cancel() with.
+ */
+TimingWheel::TimerId
+TimingWheel::add(std::shared_ptr<WorkQueue_Entry> entry, uint64_t expiresTick) {
+    Timer * timer = new Timer();
+    timer->id = nextId++;
+    timer->expires = expiresTick > currentTick ? expiresTick : currentTick + 1;
+    timer->entry = entry;
+
+    place(timer);
+    timers[timer->id] = timer;
+
+    return timer->id;
+}
+
+/**
+ * Cancel this timer. Returns false if it has already fired (or never existed).
+ */
+bool
+TimingWheel::cancel(TimerId id) {
+    auto pos = timers.find(id);
+    if (pos == timers.end()) {
+        return false;
+    }
+
+    Timer * timer = pos->second;
+    timers.erase(pos);
+    unlink(timer);
+    delete timer;
+
+    return true;
+}
+
+/**
+ * Move time forward to toTick, appending everything that comes due to due, in the
+ * order it came due. Entries due in the same tick come out together. We jump
+ * straight between the ticks where something happens.
+ */
+void
+TimingWheel::advance(uint64_t toTick, std::vector<std::shared_ptr<WorkQueue_Entry>> &due) {
+    while (currentTick < toTick) {
+        uint64_t next = nextDeadline();
+        if (next > toTick) {
+            currentTick = toTick;
+            break;
+        }
+        currentTick = next;
+
+        // When a finer wheel wraps around, the next coarser slot comes due.
+        for (int level = 1; level < Levels; ++level) {
+            if ((currentTick & ((static_cast<uint64_t>(1) << (LevelBits * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        size_t slot = static_cast<size_t>(currentTick) & (SlotsPerLevel - 1);
+        Timer * timer = slots[0][slot];
+        slots[0][slot] = nullptr;
+
+        while (timer != nullptr) {
+            Timer * next = timer->next;
+            due.push_back(std::move(timer->entry));
+            timers.erase(timer->id);
+            delete timer;
+            timer = next;
+        }
+    }
+}
+
+/**
+ * The next tick at which advance() has something to do: the first wheel has
+ * something to fire, or a coarser wheel has something to cascade. UINT64_MAX if
+ * we're empty.
+ */
+uint64_t
+TimingWheel::nextDeadline() const {
+    uint64_t retVal = UINT64_MAX;
+    if (timers.empty()) {
+        return retVal;
+    }
+
+    // Slot k ahead on each wheel comes due at the start of that wheel's k'th period from now.
+    for (int level = 0; level < Levels; ++level) {
+        int shift = LevelBits * level;
+        uint64_t period = currentTick >> shift;
+
+        for (uint64_t ahead = 1; ahead <= SlotsPerLevel; ++ahead) {
+            uint64_t tick = (period + ahead) << shift;
+            if (tick >= retVal) {
+                break;
+            }
+            if (slots[level][static_cast<size_t>(period + ahead) & (SlotsPerLevel - 1)] != nullptr) {
+                retVal = tick;
+                break;
+            }
+        }
+    }
+
+    return retVal;
+}
@@ -0,0 +1,71 @@
+#ifndef SRC_LIB_TIMINGWHEEL_H_
+#define SRC_LIB_TIMINGWHEEL_H_
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class WorkQueue_Entry;
+
+/**
+ * A hashed hierarchical timing wheel, for holding lots of timed entries cheaply.
+ * Time is in ticks; what a tick means is up to you (WorkQueue_Runner uses
+ * milliseconds). Adding and cancelling are O(1), and advance() hands back
+ * everything due in a tick at once.
+ *
+ * There are four wheels of 256 slots. The first holds whatever is due in the next
+ * 256 ticks, one slot per tick. Each wheel above it covers 256 times the span of
+ * the one below, and as time reaches a slot, its entries drop down to a finer
+ * wheel. Anything further out than the top wheel reaches (about 49 days of
+ * milliseconds) waits in the top wheel and is placed again as time goes by.
+ *
+ * We aren't thread-safe. Whoever owns us should hold a lock.
+ */
+class TimingWheel {
+public:
+    typedef uint64_t TimerId;
+
+    static const int		LevelBits = 8;
+    static const int		Levels = 4;
+    static const size_t		SlotsPerLevel = 1 << LevelBits;
+
+private:
+    class Timer {
+    public:
+        TimerId					id = 0;
+        uint64_t				expires = 0;
+        std::shared_ptr<WorkQueue_Entry>	entry;
+        Timer *					previous = nullptr;
+        Timer *					next = nullptr;
+        int						level = 0;
+        size_t					slot = 0;
+    };
+
+    Timer *		slots[Levels][SlotsPerLevel] = {};
+
+    /** The last tick we've processed. */
+    uint64_t	currentTick = 0;
+    TimerId		nextId = 1;
+
+    /** So cancel() can find a timer. */
+    std::unordered_map<TimerId, Timer *>	timers;
+
+    void place(Timer *timer);
+    void unlink(Timer *timer);
+    void cascade(int level);
+
+public:
+    TimingWheel(uint64_t startTick = 0): currentTick(startTick) {}
+    ~TimingWheel();
+
+    TimerId add(std::shared_ptr<WorkQueue_Entry> entry, uint64_t expiresTick);
+    bool cancel(TimerId id);
+    void advance(uint64_t toTick, std::vector<std::shared_ptr<WorkQueue_Entry>> &due);
+
+    uint64_t nextDeadline() const;
+    uint64_t getCurrentTick() const { return currentTick; }
+    size_t size() const { return timers.size(); }
+};
+
+#endif /* SRC_LIB_TIMINGWHEEL_H_ */
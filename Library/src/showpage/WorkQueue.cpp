@@ -2,6 +2,7 @@
 #include <iostream>
 #include <thread>
 #include <algorithm>
+#include <vector>
 
 #include "WorkQueue.h"
 
@@ -52,7 +53,7 @@ WorkQueue_Base::baseAdd(WorkQueue_Entry::Ptr entry)
 void
 WorkQueue_Base::baseAddIfEmpty(WorkQueue_Entry::Ptr entry) {
     std::unique_lock<std::mutex> mlock(mutex);
-    if (head != nullptr) {
+    if (head == nullptr) {
         _add(entry);
     }
 }
@@ -63,7 +64,7 @@ WorkQueue_Base::baseAddIfEmpty(WorkQueue_Entry::Ptr entry) {
 void
 WorkQueue_Base::baseAddIfEmpty(WorkQueue_Entry::Ptr entry, const long millisecondDelay) {
     std::unique_lock<std::mutex> mlock(mutex);
-    if (head != nullptr) {
+    if (head == nullptr) {
         entry->fireAt = system_clock::now() + milliseconds(millisecondDelay);
         _add(entry);
     }
@@ -825,11 +826,14 @@ WorkQueueRunner_Entry::~WorkQueueRunner_Entry() {
 }
 
 /**
- * Invoke our method.
+ * Invoke our method. An entry without one does nothing; WorkQueue_Runner uses
+ * those to wake itself up.
  */
 void
 WorkQueueRunner_Entry::invoke() {
-	function(object);
+    if (function) {
+        function(object);
+    }
 }
 
 /**
@@ -843,7 +847,9 @@ workqueueRunMethod() {
 /**
  * Constructor.
  */
-WorkQueue_Runner::WorkQueue_Runner() {
+WorkQueue_Runner::WorkQueue_Runner()
+    : wheelStart(steady_clock::now())
+{
 }
 
 /**
@@ -867,15 +873,101 @@ WorkQueue_Runner::singleton() {
 }
 
 /**
- * Run forever.
+ * Run forever. Between queue entries, we fire whatever the timing wheel says is
+ * due, and we never sleep past the wheel's next deadline.
  */
 void
 WorkQueue_Runner::run() {
 	while(true) {
-        WorkQueue_Entry::Ptr ptr = getMoreWork();
+        WorkQueue_Entry::Ptr ptr = getMoreWork(fireTimers());
         if (ptr != nullptr) {
             WorkQueueRunner_Entry & entry = static_cast<WorkQueueRunner_Entry &>(*ptr);
             entry.invoke();
 		}
 	}
 }
+
+/**
+ * Milliseconds since we started, which is what our wheel ticks in.
+ */
+uint64_t
+WorkQueue_Runner::currentTick() const {
+    return static_cast<uint64_t>(duration_cast<milliseconds>(steady_clock::now() - wheelStart).count());
+}
+
+/**
+ * Fire everything on the wheel that's due, all together, and say how long we can
+ * wait before we need to look again. The callbacks take time, so we work that out
+ * from the clock after they've run, not before.
+ */
+milliseconds
+WorkQueue_Runner::fireTimers() {
+    vector<WorkQueue_Entry::Ptr> due;
+    const uint64_t maxWait = 3600000;	// one hour
+
+    {
+        std::unique_lock<std::mutex> mlock(timerMutex);
+        uint64_t now = currentTick();
+
+        wheel.advance(now, due);
+        plannedWakeTick = wheel.nextDeadline();
+        if (plannedWakeTick == UINT64_MAX || plannedWakeTick - now >= maxWait) {
+            plannedWakeTick = now + maxWait;
+        }
+    }
+
+    // Outside the lock, so callbacks can schedule more.
+    for (WorkQueue_Entry::Ptr &ptr: due) {
+        static_cast<WorkQueueRunner_Entry &>(*ptr).invoke();
+    }
+
+    // Anything the callbacks scheduled sooner has already pulled plannedWakeTick in.
+    std::unique_lock<std::mutex> mlock(timerMutex);
+    uint64_t now = currentTick();
+
+    return milliseconds(plannedWakeTick > now ? plannedWakeTick - now : 0);
+}
+
+/**
+ * Fire this entry after this many milliseconds. Returns an id for cancel().
+ */
+TimingWheel::TimerId
+WorkQueue_Runner::schedule(Ptr entry, const long millisecondDelay) {
+    bool nudge = false;
+    TimingWheel::TimerId id;
+
+    {
+        std::unique_lock<std::mutex> mlock(timerMutex);
+        uint64_t expires = currentTick() + static_cast<uint64_t>(millisecondDelay > 0 ? millisecondDelay : 0);
+
+        id = wheel.add(std::static_pointer_cast<WorkQueue_Entry>(entry), expires);
+        if (expires < plannedWakeTick) {
+            plannedWakeTick = expires;
+            nudge = true;
+        }
+    }
+
+    // The run loop is asleep past when this is due, so wake it with an empty entry.
+    if (nudge) {
+        addFront(make_shared<WorkQueueRunner_Entry>(system_clock::time_point()));
+    }
+
+    return id;
+}
+
+/**
+ * Call function(object) after this many milliseconds. Returns an id for cancel().
+ */
+TimingWheel::TimerId
+WorkQueue_Runner::schedule(WorkQueueRunner_Entry::WorkQueue_Function function, void *object, const long millisecondDelay) {
+    return schedule(make_shared<WorkQueueRunner_Entry>(function, object, system_clock::time_point()), millisecondDelay);
+}
+
+/**
+ * Cancel something we scheduled. Returns false if it's already fired or firing.
+ */
+bool
+WorkQueue_Runner::cancel(TimingWheel::TimerId id) {
+    std::unique_lock<std::mutex> mlock(timerMutex);
+    return wheel.cancel(id);
+}
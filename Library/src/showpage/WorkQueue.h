@@ -7,6 +7,9 @@
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include <cstdint>
+
+#include "TimingWheel.h"
 
 /**
  * WorkQueue holds instances of these. (You can subclass.)
@@ -228,13 +231,20 @@ public:
 };
 
 /**
- * This defines a generic type.
+ * This defines a generic type. Base is the queue underneath, which is normally
+ * WorkQueue_Base, but see LockFreeWorkQueue_Base.
  */
-template<typename T>
-class WorkQueue_Template: public WorkQueue_Base {
+template<typename T, class Base = WorkQueue_Base>
+class WorkQueue_Template: public Base {
 public:
     typedef std::shared_ptr<T> Ptr;
 
+    using Base::Base;
+    using Base::baseAdd;
+    using Base::baseAddFront;
+    using Base::baseAddIfEmpty;
+    using Base::baseGetMoreWork;
+
     void add(Ptr ptr) { baseAdd( std::static_pointer_cast<WorkQueue_Entry>(ptr) ); }
     void addFront(Ptr ptr) { baseAddFront( std::static_pointer_cast<WorkQueue_Entry>(ptr) ); }
     void add(Ptr ptr, const long millisecondDelay) { baseAdd( std::static_pointer_cast<WorkQueue_Entry>(ptr), millisecondDelay ); }
@@ -299,19 +309,38 @@ public:
 
 /**
  * This implements a thread of timed callbacks.
+ *
+ * You can add entries the usual WorkQueue way, but for lots of short delays (such
+ * as one per note while a song plays) use schedule() instead. Those go on a timing
+ * wheel with millisecond ticks, where scheduling and cancelling are O(1), and
+ * everything due in the same tick fires together.
  */
 class WorkQueue_Runner: public WorkQueue_Template<WorkQueueRunner_Entry> {
 private:
 	static WorkQueue_Runner *	mySingleton;
 	static std::mutex			mutex;
 
+    std::mutex					timerMutex;
+    TimingWheel					wheel;
+    std::chrono::steady_clock::time_point	wheelStart;
+
+    /** The tick the run loop plans to wake at. If we schedule something sooner, we nudge it. */
+    uint64_t					plannedWakeTick = UINT64_MAX;
+
 	WorkQueue_Runner();
 
+    uint64_t currentTick() const;
+    std::chrono::milliseconds fireTimers();
+
 public:
 	static WorkQueue_Runner *	singleton();
 
 	virtual ~WorkQueue_Runner();
 	void run();
+
+    TimingWheel::TimerId schedule(Ptr entry, const long millisecondDelay);
+    TimingWheel::TimerId schedule(WorkQueueRunner_Entry::WorkQueue_Function function, void *object, const long millisecondDelay);
+    bool cancel(TimingWheel::TimerId id);
 };
 
 #endif /* SRC_LIB_WORKQUEUE_H_ */
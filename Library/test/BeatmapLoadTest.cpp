@@ -0,0 +1,134 @@
+/**
+ * Regression tests for loading beatmaps. SongBeatmapData::load() streams the JSON
+ * rather than building a DOM, so we check it against fromJSON() on maps carrying
+ * everything real maps have beside notes and events: _BPMChanges, _obstacles,
+ * _customData on the map and on individual notes and events, and so on.
+ *
+ * To run:
+ *
+ * 		make test
+ *
+ * Prints each case and exits non-zero if any of them fail.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include <beat_patterns/Song.h>
+
+using namespace std;
+using namespace BeatPatterns;
+using JSON = nlohmann::json;
+
+static int failures = 0;
+
+/**
+ * Write this map out, load it both ways, and compare.
+ */
+static void
+checkLoad(const string &name, const string &dir, const string &text) {
+    string fileName = dir + "/" + name + ".dat";
+    {
+        ofstream file(fileName);
+        file << text;
+    }
+
+    SongBeatmapData streamed;
+    streamed.load(fileName);
+
+    SongBeatmapData parsed;
+    parsed.fromJSON(JSON::parse(text));
+
+    bool ok = streamed.version == parsed.version
+        && streamed.notes.size() == parsed.notes.size()
+        && streamed.events.size() == parsed.events.size();
+
+    for (size_t index = 0; ok && index < parsed.notes.size(); ++index) {
+        const SongBeatmapData::Note & a = streamed.notes[index];
+        const SongBeatmapData::Note & b = parsed.notes[index];
+        ok = a.time == b.time && a.lineIndex == b.lineIndex && a.lineLayer == b.lineLayer
+            && a.type == b.type && a.cutDirection == b.cutDirection;
+    }
+    for (size_t index = 0; ok && index < parsed.events.size(); ++index) {
+        const SongBeatmapData::Event & a = streamed.events[index];
+        const SongBeatmapData::Event & b = parsed.events[index];
+        ok = a.time == b.time && a.type == b.type && a.value == b.value;
+    }
+
+    cout << (ok ? "ok     " : "FAILED ") << name
+         << ": notes " << streamed.notes.size() << " of " << parsed.notes.size()
+         << ", events " << streamed.events.size() << " of " << parsed.events.size() << endl;
+
+    if (!ok) {
+        ++failures;
+    }
+}
+
+static const char * Notes =
+    "\"_notes\":["
+        "{\"_time\":4,\"_lineIndex\":1,\"_lineLayer\":0,\"_type\":0,\"_cutDirection\":1},"
+        "{\"_time\":4.5,\"_lineIndex\":2,\"_lineLayer\":1,\"_type\":1,\"_cutDirection\":0}]";
+
+static const char * Events =
+    "\"_events\":[{\"_time\":2,\"_type\":1,\"_value\":3}]";
+
+/**
+ * A map with many notes, each carrying _customData, so it's big enough to be mapped
+ * rather than read.
+ */
+static string
+largeMap() {
+    ostringstream text;
+
+    text << "{\"_version\":\"2.0.0\",\"_BPMChanges\":[{\"_time\":0,\"_BPM\":120}],\"_notes\":[";
+    for (int index = 0; index < 5000; ++index) {
+        text << (index > 0 ? "," : "")
+             << "{\"_time\":" << index * 0.5 << ",\"_customData\":{\"_color\":[1,0,0],\"_position\":[0,1]}"
+             << ",\"_lineIndex\":" << index % 4 << ",\"_lineLayer\":" << index % 3
+             << ",\"_type\":" << index % 2 << ",\"_cutDirection\":" << index % 9 << "}";
+    }
+    text << "]," << Events << "}";
+    return text.str();
+}
+
+int main(int, char **) {
+    boost::filesystem::path tempDir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("BeatmapLoadTest-%%%%%%");
+    boost::filesystem::create_directories(tempDir);
+    string dir = tempDir.string();
+
+    checkLoad("plain", dir,
+        string("{\"_version\":\"2.0.0\",") + Events + "," + Notes + "}");
+
+    checkLoad("bpmChanges", dir,
+        string("{\"_version\":\"2.0.0\",\"_BPMChanges\":[{\"_time\":0,\"_BPM\":120,\"_beatsPerBar\":4}],")
+        + Events + "," + Notes + "}");
+
+    checkLoad("noteCustomData", dir,
+        "{\"_version\":\"2.0.0\",\"_notes\":["
+            "{\"_time\":4,\"_lineIndex\":1,\"_lineLayer\":0,\"_type\":0,\"_cutDirection\":1,\"_customData\":{\"_color\":[1,0,0]}},"
+            "{\"_time\":4.5,\"_lineIndex\":2,\"_lineLayer\":1,\"_type\":1,\"_cutDirection\":0}],"
+        + string(Events) + "}");
+
+    checkLoad("eventCustomData", dir,
+        "{\"_version\":\"2.0.0\",\"_events\":["
+            "{\"_time\":2,\"_customData\":{\"_propID\":[{\"_id\":4}],\"_lightGradient\":{\"_duration\":1}},\"_type\":1,\"_value\":3},"
+            "{\"_time\":3,\"_type\":2,\"_value\":1}],"
+        + string(Notes) + "}");
+
+    checkLoad("obstacles", dir,
+        string("{\"_version\":\"2.0.0\",\"_obstacles\":[{\"_time\":1,\"_lineIndex\":0,\"_type\":0,\"_duration\":2,\"_width\":1}],")
+        + Notes + ",\"_waypoints\":[]," + Events + "}");
+
+    checkLoad("mapCustomData", dir,
+        string("{\"_version\":\"2.0.0\",\"_customData\":{\"_time\":9,\"_bookmarks\":[{\"_time\":1,\"_name\":\"a\"}],\"_empty\":{}},")
+        + Notes + "," + Events + ",\"_specialEventsKeywordFilters\":{}}");
+
+    checkLoad("large", dir, largeMap());
+
+    boost::filesystem::remove_all(tempDir);
+
+    return failures == 0 ? 0 : 1;
+}
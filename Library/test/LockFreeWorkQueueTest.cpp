@@ -0,0 +1,212 @@
+/**
+ * Behaviour tests for LockFreeWorkQueue: entries come out first-in, first-out,
+ * including once the ring has filled and producers have spilled into the
+ * overflow list; timed entries wait in the heap until they're due; and
+ * addFront() still jumps the queue.
+ *
+ * To run:
+ *
+ * 		make test
+ *
+ * Prints each case and exits non-zero if any of them fail.
+ */
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <showpage/LockFreeWorkQueue.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static int failures = 0;
+
+/**
+ * An entry that knows who added it and in what order.
+ */
+class NumberedEntry: public WorkQueue_Entry {
+public:
+    size_t producer;
+    size_t number;
+
+    NumberedEntry(size_t _producer, size_t _number): producer(_producer), number(_number) {}
+};
+
+typedef WorkQueue_Template<NumberedEntry, LockFreeWorkQueue_Base> NumberedQueue;
+
+static void
+report(const string &name, bool ok, const string &detail) {
+    cout << (ok ? "ok     " : "FAILED ") << name << ": " << detail << endl;
+    if (!ok) {
+        ++failures;
+    }
+}
+
+/**
+ * Take out whatever's ready right now, in the order we get it.
+ */
+static vector<size_t>
+drain(NumberedQueue &queue) {
+    vector<size_t> retVal;
+    NumberedQueue::Ptr entry;
+    while ( (entry = queue.getMoreWork(milliseconds(0))) != nullptr) {
+        retVal.push_back(entry->number);
+    }
+    return retVal;
+}
+
+static bool
+inOrder(const vector<size_t> &numbers, size_t count) {
+    if (numbers.size() != count) {
+        return false;
+    }
+    for (size_t index = 0; index < count; ++index) {
+        if (numbers[index] != index) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * One producer, plenty of room.
+ */
+static void
+testFifo() {
+    NumberedQueue queue;
+    for (size_t index = 0; index < 1000; ++index) {
+        queue.add(make_shared<NumberedEntry>(0, index));
+    }
+    vector<size_t> numbers = drain(queue);
+
+    report("fifo", inOrder(numbers, 1000) && queue.size() == 0,
+        to_string(numbers.size()) + " of 1000 in order");
+}
+
+/**
+ * A ring of 8 with 100 entries added before anyone takes one, so most of them
+ * go through the overflow list. They still come out in order, and once we've
+ * caught up the ring is used again.
+ */
+static void
+testOverflow() {
+    NumberedQueue queue(8);
+    for (size_t index = 0; index < 100; ++index) {
+        queue.add(make_shared<NumberedEntry>(0, index));
+    }
+    vector<size_t> numbers = drain(queue);
+    bool ok = inOrder(numbers, 100) && queue.size() == 0;
+
+    for (size_t index = 0; index < 5; ++index) {
+        queue.add(make_shared<NumberedEntry>(0, index));
+    }
+    vector<size_t> again = drain(queue);
+    ok = ok && inOrder(again, 5);
+
+    report("overflow", ok, to_string(numbers.size()) + " of 100, then " + to_string(again.size()) + " of 5, in order");
+}
+
+/**
+ * Several producers racing into a small ring while the consumer drains it. Each
+ * producer's entries must come out in the order it added them.
+ */
+static void
+testProducers() {
+    const size_t producerCount = 4;
+    const size_t perProducer = 20000;
+
+    NumberedQueue queue(16);
+    vector<thread> producers;
+    for (size_t producer = 0; producer < producerCount; ++producer) {
+        producers.emplace_back([&queue, producer]() {
+            for (size_t index = 0; index < perProducer; ++index) {
+                queue.add(make_shared<NumberedEntry>(producer, index));
+            }
+        });
+    }
+
+    vector<size_t> nextExpected(producerCount, 0);
+    size_t received = 0;
+    bool ok = true;
+    while (received < producerCount * perProducer) {
+        NumberedQueue::Ptr entry = queue.getMoreWork(milliseconds(1000));
+        if (entry == nullptr) {
+            ok = false;
+            break;
+        }
+        ok = ok && entry->number == nextExpected[entry->producer];
+        nextExpected[entry->producer] = entry->number + 1;
+        ++received;
+    }
+
+    for (thread &producer: producers) {
+        producer.join();
+    }
+
+    report("producers", ok && queue.size() == 0,
+        to_string(received) + " of " + to_string(producerCount * perProducer) + ", each producer in order");
+}
+
+/**
+ * Entries not due yet go to the heap and come out when they're due, earliest
+ * first and equal times in the order added, behind anything untimed.
+ */
+static void
+testTimed() {
+    NumberedQueue queue;
+    system_clock::time_point start = system_clock::now();
+
+    auto timed = [&](size_t number, long delay) {
+        NumberedQueue::Ptr entry = make_shared<NumberedEntry>(0, number);
+        entry->fireAt = start + milliseconds(delay);
+        return entry;
+    };
+    queue.add(timed(3, 80));
+    queue.add(timed(1, 40));
+    queue.add(make_shared<NumberedEntry>(0, 0));
+    queue.add(timed(2, 40));
+
+    bool ok = true;
+    NumberedQueue::Ptr entry = queue.getMoreWork(milliseconds(0));
+    ok = entry != nullptr && entry->number == 0;
+    ok = ok && queue.getMoreWork(milliseconds(0)) == nullptr && queue.size() == 3;
+
+    vector<size_t> numbers;
+    while (ok && numbers.size() < 3) {
+        entry = queue.getMoreWork(milliseconds(1000));
+        if (entry == nullptr || system_clock::now() < entry->fireAt) {
+            ok = false;
+            break;
+        }
+        numbers.push_back(entry->number);
+    }
+    ok = ok && numbers == vector<size_t>({ 1, 2, 3 });
+
+    report("timed", ok, "untimed first, then by fireAt, none early");
+}
+
+/**
+ * addFront() entries come out before the rest, newest first.
+ */
+static void
+testAddFront() {
+    NumberedQueue queue;
+    queue.add(make_shared<NumberedEntry>(0, 2));
+    queue.add(make_shared<NumberedEntry>(0, 3));
+    queue.addFront(make_shared<NumberedEntry>(0, 1));
+    queue.addFront(make_shared<NumberedEntry>(0, 0));
+
+    vector<size_t> numbers = drain(queue);
+    report("addFront", inOrder(numbers, 4), "newest front entry first, then the rest");
+}
+
+int main(int, char **) {
+    testFifo();
+    testOverflow();
+    testProducers();
+    testTimed();
+    testAddFront();
+
+    return failures == 0 ? 0 : 1;
+}
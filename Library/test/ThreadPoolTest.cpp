@@ -0,0 +1,150 @@
+/**
+ * Behaviour tests for ThreadPool: parallel_for visits every index once, passes
+ * an exception from the body back to the caller after the other chunks finish,
+ * and can be nested inside itself without deadlocking. submit() hands back
+ * results and exceptions through its future.
+ *
+ * To run:
+ *
+ * 		make test
+ *
+ * Prints each case and exits non-zero if any of them fail.
+ */
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <showpage/ThreadPool.h>
+
+using namespace std;
+
+static int failures = 0;
+
+static void
+report(const string &name, bool ok, const string &detail) {
+    cout << (ok ? "ok     " : "FAILED ") << name << ": " << detail << endl;
+    if (!ok) {
+        ++failures;
+    }
+}
+
+/**
+ * Every index exactly once.
+ */
+static void
+testCoverage(ThreadPool &pool) {
+    const size_t count = 100000;
+    vector<atomic<int>> visits(count);
+    for (atomic<int> &visit: visits) {
+        visit = 0;
+    }
+
+    pool.parallel_for(0, count, [&](size_t index) { ++visits[index]; });
+
+    size_t once = 0;
+    for (atomic<int> &visit: visits) {
+        once += visit == 1 ? 1 : 0;
+    }
+    report("coverage", once == count, to_string(once) + " of " + to_string(count) + " visited once");
+}
+
+/**
+ * One index throws. We should get that exception back, and only after every
+ * other chunk has run. The rest of the chunk that threw is skipped.
+ */
+static void
+testException(ThreadPool &pool) {
+    const size_t count = 1000;
+    atomic<size_t> visited(0);
+    string caught;
+
+    try {
+        pool.parallel_for(0, count, [&](size_t index) {
+            if (index == 500) {
+                throw runtime_error("index 500");
+            }
+            ++visited;
+        }, 10);
+    }
+    catch (const runtime_error &e) {
+        caught = e.what();
+    }
+
+    // Chunks of 10, so 500 up to 509 don't count.
+    report("exception", caught == "index 500" && visited == count - 10,
+        "caught \"" + caught + "\" after " + to_string(visited) + " of " + to_string(count - 10) + " in other chunks");
+}
+
+/**
+ * parallel_for inside parallel_for, with more outer indexes than threads so
+ * every worker ends up waiting on an inner loop of its own.
+ */
+static void
+testNested(ThreadPool &pool) {
+    const size_t outer = pool.size() * 4;
+    const size_t inner = 1000;
+    atomic<size_t> visited(0);
+
+    pool.parallel_for(0, outer, [&](size_t) {
+        pool.parallel_for(0, inner, [&](size_t) { ++visited; }, 50);
+    }, 1);
+
+    report("nested", visited == outer * inner,
+        to_string(visited) + " of " + to_string(outer * inner) + " inner indexes");
+}
+
+/**
+ * A nested loop that throws reaches the outer caller.
+ */
+static void
+testNestedException(ThreadPool &pool) {
+    bool caught = false;
+
+    try {
+        pool.parallel_for(0, pool.size() * 2, [&](size_t outerIndex) {
+            pool.parallel_for(0, 100, [&](size_t innerIndex) {
+                if (outerIndex == 1 && innerIndex == 50) {
+                    throw runtime_error("inner");
+                }
+            });
+        }, 1);
+    }
+    catch (const runtime_error &) {
+        caught = true;
+    }
+
+    report("nestedException", caught, caught ? "reached the outer caller" : "never caught");
+}
+
+/**
+ * submit() gives back the result, or rethrows what the task threw.
+ */
+static void
+testSubmit(ThreadPool &pool) {
+    future<int> answer = pool.submit([]() { return 42; });
+    future<int> failed = pool.submit([]() -> int { throw runtime_error("submit"); });
+
+    bool threw = false;
+    try {
+        failed.get();
+    }
+    catch (const runtime_error &) {
+        threw = true;
+    }
+
+    report("submit", answer.get() == 42 && threw, "result and exception both came back");
+}
+
+int main(int, char **) {
+    ThreadPool pool(4);
+
+    testCoverage(pool);
+    testException(pool);
+    testNested(pool);
+    testNestedException(pool);
+    testSubmit(pool);
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+/**
+ * Behaviour tests for TimingWheel and WorkQueue_Runner::schedule(): timers fire
+ * on their tick whichever wheel they started on, including past the top wheel;
+ * cancelled timers never fire; and everything due in one tick comes out of one
+ * advance(), in the order it came due.
+ *
+ * To run:
+ *
+ * 		make test
+ *
+ * Prints each case and exits non-zero if any of them fail.
+ */
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <showpage/TimingWheel.h>
+#include <showpage/WorkQueue.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static int failures = 0;
+
+/**
+ * A wheel entry that remembers which one it was.
+ */
+class NumberedEntry: public WorkQueue_Entry {
+public:
+    size_t number;
+
+    NumberedEntry(size_t _number): number(_number) {}
+};
+
+static void
+report(const string &name, bool ok, const string &detail) {
+    cout << (ok ? "ok     " : "FAILED ") << name << ": " << detail << endl;
+    if (!ok) {
+        ++failures;
+    }
+}
+
+/**
+ * Advance to this tick and say which entries came out.
+ */
+static vector<size_t>
+advanceTo(TimingWheel &wheel, uint64_t tick) {
+    vector<shared_ptr<WorkQueue_Entry>> due;
+    wheel.advance(tick, due);
+
+    vector<size_t> retVal;
+    for (shared_ptr<WorkQueue_Entry> &entry: due) {
+        retVal.push_back(static_cast<NumberedEntry &>(*entry).number);
+    }
+    return retVal;
+}
+
+/**
+ * One timer for each wheel and one past the top. Each has to cascade down to
+ * the first wheel and fire on exactly its tick: not a tick before.
+ */
+static void
+testCascade() {
+    const vector<uint64_t> expires = {
+        5,							// first wheel
+        300,						// second
+        70000,						// third
+        20000000,					// fourth
+        (1ull << 32) + 12345		// beyond the top wheel
+    };
+
+    TimingWheel wheel;
+    for (size_t index = 0; index < expires.size(); ++index) {
+        wheel.add(make_shared<NumberedEntry>(index), expires[index]);
+    }
+
+    bool ok = true;
+    string detail = "fired on";
+    for (size_t index = 0; index < expires.size(); ++index) {
+        bool early = !advanceTo(wheel, expires[index] - 1).empty();
+        vector<size_t> fired = advanceTo(wheel, expires[index]);
+        bool onTime = !early && fired == vector<size_t>({ index });
+
+        ok = ok && onTime;
+        detail += " " + to_string(expires[index]) + (onTime ? "" : "(wrong)");
+    }
+    ok = ok && wheel.size() == 0 && wheel.nextDeadline() == UINT64_MAX;
+
+    report("cascade", ok, detail);
+}
+
+/**
+ * The same timers, reached in a single advance(), come out in order.
+ */
+static void
+testOneJump() {
+    TimingWheel wheel(1000);
+    wheel.add(make_shared<NumberedEntry>(2), 1000 + 70000);
+    wheel.add(make_shared<NumberedEntry>(0), 1000 + 3);
+    wheel.add(make_shared<NumberedEntry>(1), 1000 + 300);
+
+    vector<size_t> fired = advanceTo(wheel, 1000 + 100000);
+    report("oneJump", fired == vector<size_t>({ 0, 1, 2 }) && wheel.getCurrentTick() == 101000,
+        to_string(fired.size()) + " of 3 in order");
+}
+
+/**
+ * Cancelled timers, on any wheel, never fire. Cancelling twice, or after the
+ * timer has fired, says no.
+ */
+static void
+testCancel() {
+    TimingWheel wheel;
+    TimingWheel::TimerId near = wheel.add(make_shared<NumberedEntry>(0), 10);
+    TimingWheel::TimerId kept = wheel.add(make_shared<NumberedEntry>(1), 20);
+    TimingWheel::TimerId far = wheel.add(make_shared<NumberedEntry>(2), 100000);
+
+    bool ok = wheel.cancel(near) && wheel.cancel(far) && !wheel.cancel(near) && wheel.size() == 1;
+
+    vector<size_t> fired = advanceTo(wheel, 200000);
+    ok = ok && fired == vector<size_t>({ 1 }) && !wheel.cancel(kept);
+
+    report("cancel", ok, "only the uncancelled timer fired");
+}
+
+/**
+ * Timers due in the same tick come out of one advance() together, after
+ * anything due earlier.
+ */
+static void
+testSameTick() {
+    TimingWheel wheel;
+    for (size_t index = 1; index <= 5; ++index) {
+        wheel.add(make_shared<NumberedEntry>(index), 1000);
+    }
+    wheel.add(make_shared<NumberedEntry>(0), 999);
+
+    bool ok = advanceTo(wheel, 998).empty();
+    vector<size_t> fired = advanceTo(wheel, 1000);
+
+    ok = ok && fired.size() == 6 && fired[0] == 0;
+    for (size_t index = 1; ok && index < 6; ++index) {
+        ok = fired[index] >= 1 && fired[index] <= 5;
+    }
+
+    report("sameTick", ok && wheel.size() == 0, to_string(fired.size()) + " of 6 in one advance");
+}
+
+/**
+ * Through WorkQueue_Runner: callbacks fire, not before their delay, all the
+ * ones sharing a delay fire, and a cancelled one doesn't.
+ */
+static void
+testRunner() {
+    const size_t count = 20;
+    const long delay = 50;
+
+    WorkQueue_Runner * runner = WorkQueue_Runner::singleton();
+
+    atomic<size_t> fired(0);
+    atomic<size_t> early(0);
+    atomic<bool> cancelledFired(false);
+    steady_clock::time_point start = steady_clock::now();
+
+    for (size_t index = 0; index < count; ++index) {
+        runner->schedule([&](void *) {
+            // Ticks are whole milliseconds, so allow for starting partway through one.
+            if (steady_clock::now() - start < milliseconds(delay - 1)) {
+                ++early;
+            }
+            ++fired;
+        }, nullptr, delay);
+    }
+    TimingWheel::TimerId cancelled = runner->schedule([&](void *) { cancelledFired = true; }, nullptr, delay);
+    bool cancelOk = runner->cancel(cancelled);
+
+    // A later timer to show the runner has moved on past the first batch.
+    atomic<bool> laterFired(false);
+    runner->schedule([&](void *) { laterFired = true; }, nullptr, delay * 2);
+
+    steady_clock::time_point giveUp = steady_clock::now() + seconds(5);
+    while (!laterFired && steady_clock::now() < giveUp) {
+        this_thread::sleep_for(milliseconds(5));
+    }
+
+    bool ok = cancelOk && laterFired && fired == count && early == 0 && !cancelledFired;
+    report("runner", ok, to_string(fired) + " of " + to_string(count) + " fired, "
+        + to_string(early) + " early, cancelled one " + (cancelledFired ? "fired" : "didn't fire"));
+}
+
+int main(int, char **) {
+    testCascade();
+    testOneJump();
+    testCancel();
+    testSameTick();
+    testRunner();
+
+    return failures == 0 ? 0 : 1;
+}